@@ -1,6 +1,13 @@
 #pragma once
 
 #include "lucmath.h"
+#include <type_traits>
+
+template<typename T>
+struct is_affine_transform : std::false_type {};
+
+template<typename T>
+struct is_affine_transform<luc::AffineT<T>> : std::true_type {};
 
 template<typename T>
 struct animated
@@ -8,8 +15,13 @@ struct animated
 	T t0, t1;
 	animated() = default;
 	animated(T _t0, T _t1) : t0(_t0), t1(_t1) { }
-	T lerp(float t)
+	T lerp(float t) const
 	{
-		return luc::Lerp<T>(t, t0, t1);
+		// affine keys blend column by column in their own scalar type, everything else keeps the
+		// explicit Lerp<T> so t converts to T
+		if constexpr (is_affine_transform<T>::value)
+			return luc::Lerp(std::remove_cvref_t<decltype(t0.E[0])>(t), t0, t1);
+		else
+			return luc::Lerp<T>(t, t0, t1);
 	}
 };
\ No newline at end of file
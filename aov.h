@@ -0,0 +1,78 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include <tuple>
+#include <type_traits>
+
+template<typename T>
+struct aov_channel
+{
+	using type = T;
+};
+
+struct aov_beauty : aov_channel<luc::Vector3> {};
+struct aov_albedo : aov_channel<luc::Vector3> {};
+struct aov_normal : aov_channel<luc::Vector3> {};
+struct aov_depth : aov_channel<float> {};
+
+template<typename TChannel, typename... TChannels>
+constexpr size_t aov_channel_index()
+{
+	constexpr bool matches[] = { std::is_same_v<TChannel, TChannels>... };
+	for (size_t i = 0; i < sizeof...(TChannels); i++)
+	{
+		if (matches[i])
+			return i;
+	}
+	return sizeof...(TChannels);
+}
+
+template<typename... TChannels>
+struct aov_framebuffer;
+
+template<typename... TChannels>
+struct aov_pixel
+{
+	aov_framebuffer<TChannels...>* framebuffer;
+	size_t index;
+	template<typename TChannel>
+	auto& get()
+	{
+		return framebuffer->template plane<TChannel>().pixels[index];
+	}
+	template<typename TChannel>
+	void set(const typename TChannel::type& value)
+	{
+		get<TChannel>() = value;
+	}
+};
+
+// every channel lives in its own plane so consumers of a single aov read it at full bandwidth
+template<typename... TChannels>
+struct aov_framebuffer
+{
+	int width, height;
+	std::tuple<framebuffer<typename TChannels::type>...> planes;
+	aov_framebuffer() = default;
+	aov_framebuffer(int _width, int _height) : width(_width), height(_height), planes(framebuffer<typename TChannels::type>(_width, _height)...) {}
+	template<typename TChannel>
+	auto& plane()
+	{
+		constexpr auto index = aov_channel_index<TChannel, TChannels...>();
+		static_assert(index < sizeof...(TChannels), "channel is not part of this framebuffer");
+		return std::get<index>(planes);
+	}
+	aov_pixel<TChannels...> pixel(int x, int y)
+	{
+		return { this, size_t(x + y * width) };
+	}
+};
+
+template<typename TSize, typename TFloat = float, typename... TChannels>
+void iterate_over_tile(const work_block<TSize>& block, aov_framebuffer<TChannels...>& aovs, auto&& item_func)
+{
+	iterate_over_tile<TSize, TFloat>(block, [&](TSize x, TSize y, auto&& transform)
+	{
+		item_func(x, y, transform, aovs.pixel(x, y));
+	});
+}
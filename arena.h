@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+struct arena;
+
+struct arena_resource : std::pmr::memory_resource
+{
+	arena* owner;
+	arena_resource(arena* _owner) : owner(_owner) {}
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void*, size_t, size_t) override {}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+// bump allocator, reset() rewinds to the first block but keeps every block for reuse
+struct arena
+{
+	struct block
+	{
+		std::unique_ptr<std::byte[]> data;
+		size_t size;
+	};
+	struct position
+	{
+		size_t current = 0;
+		size_t offset = 0;
+	};
+	std::vector<block> blocks;
+	size_t current = 0;
+	size_t offset = 0;
+	size_t block_size;
+	arena_resource resource;
+
+	arena(size_t _block_size = size_t(64) << 10) : block_size(_block_size), resource(this) {}
+	arena(const arena&) = delete;
+	arena& operator=(const arena&) = delete;
+
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+	{
+		while (current < blocks.size())
+		{
+			auto& target = blocks[current];
+			const auto address = reinterpret_cast<uintptr_t>(target.data.get());
+			const auto aligned = (address + offset + alignment - 1) / alignment * alignment;
+			if (aligned + bytes <= address + target.size)
+			{
+				offset = aligned + bytes - address;
+				return reinterpret_cast<void*>(aligned);
+			}
+			current++;
+			offset = 0;
+		}
+		const auto size = std::max(block_size, bytes + alignment);
+		blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+		return allocate(bytes, alignment);
+	}
+
+	template<typename T>
+	T* allocate_array(size_t count)
+	{
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void reset()
+	{
+		current = 0;
+		offset = 0;
+	}
+
+	// rewinding to a mark frees everything allocated after it, marks nest like a stack
+	position mark() const
+	{
+		return { current, offset };
+	}
+
+	void rewind(const position& mark)
+	{
+		current = mark.current;
+		offset = mark.offset;
+	}
+};
+
+inline void* arena_resource::do_allocate(size_t bytes, size_t alignment)
+{
+	return owner->allocate(bytes, alignment);
+}
+
+// hands every parallel_for its own set of per worker arenas and takes them back afterwards, so
+// the blocks grown in one frame are reused by the next and nested loops never share an arena
+struct arena_pool
+{
+	std::mutex mutex;
+	std::vector<std::vector<std::unique_ptr<arena>>> free_sets;
+
+	static arena_pool& global()
+	{
+		static arena_pool pool;
+		return pool;
+	}
+
+	std::vector<std::unique_ptr<arena>> acquire(size_t count)
+	{
+		std::vector<std::unique_ptr<arena>> set;
+		{
+			std::scoped_lock lock(mutex);
+			if (!free_sets.empty())
+			{
+				set = std::move(free_sets.back());
+				free_sets.pop_back();
+			}
+		}
+		while (set.size() < count)
+		{
+			set.push_back(std::make_unique<arena>());
+		}
+		return set;
+	}
+
+	void release(std::vector<std::unique_ptr<arena>> set)
+	{
+		for (auto& scratch : set)
+		{
+			scratch->reset();
+		}
+		std::scoped_lock lock(mutex);
+		free_sets.push_back(std::move(set));
+	}
+
+	// frees the arenas no parallel_for is using, after a large frame or when going idle
+	void trim()
+	{
+		std::vector<std::vector<std::unique_ptr<arena>>> sets;
+		std::scoped_lock lock(mutex);
+		std::swap(sets, free_sets);
+	}
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include "parallel_for.h"
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+inline bool save_parallel_for_settings(const char* path, const parallel_for_settings& settings)
+{
+	auto* file = std::fopen(path, "w");
+	if (!file)
+		return false;
+	std::fprintf(file, "hardware_concurrency=%u\n", std::thread::hardware_concurrency());
+	std::fprintf(file, "thread_count=%zu\n", settings.thread_count);
+	std::fprintf(file, "max_size=%d\n", settings.max_size);
+	std::fprintf(file, "split_size=%d\n", settings.split_size);
+	return std::fclose(file) == 0;
+}
+
+// only accepts a file written on a machine with the same number of hardware threads
+inline bool load_parallel_for_settings(const char* path, parallel_for_settings& settings)
+{
+	auto* file = std::fopen(path, "r");
+	if (!file)
+		return false;
+	unsigned hardware_concurrency = 0;
+	parallel_for_settings loaded;
+	const auto fields = std::fscanf(file, "hardware_concurrency=%u thread_count=%zu max_size=%d split_size=%d", &hardware_concurrency, &loaded.thread_count, &loaded.max_size, &loaded.split_size);
+	std::fclose(file);
+	if (fields != 4 || hardware_concurrency != std::thread::hardware_concurrency() || loaded.thread_count == 0 || loaded.max_size <= 0 || loaded.split_size < 1)
+		return false;
+	settings = loaded;
+	return true;
+}
+
+// times tile_func over a width x height frame for each candidate, tuning one parameter at a time
+// against the best values found so far, and leaves the winner in parallel_for_defaults()
+inline parallel_for_settings autotune_parallel_for(int width, int height, auto&& tile_func, int repetitions = 3)
+{
+	auto& defaults = parallel_for_defaults();
+	const auto hardware_concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+	auto best = defaults;
+	best.thread_count = parallel_for_thread_count();
+	auto measure = [&](const parallel_for_settings& candidate)
+	{
+		defaults = candidate;
+		auto fastest = std::numeric_limits<double>::max();
+		for (int i = 0; i < repetitions; i++)
+		{
+			abort_token aborter;
+			const auto domain = generate_parallel_for_domain(width, height);
+			const auto start = std::chrono::steady_clock::now();
+			parallel_for(domain, tile_func, aborter);
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			fastest = std::min(fastest, elapsed.count());
+		}
+		return fastest;
+	};
+	auto best_time = measure(best);
+	auto tune = [&](auto member, std::initializer_list<std::remove_reference_t<decltype(best.*member)>> values)
+	{
+		for (const auto value : values)
+		{
+			auto candidate = best;
+			candidate.*member = value;
+			const auto time = measure(candidate);
+			if (time < best_time)
+			{
+				best_time = time;
+				best = candidate;
+			}
+		}
+	};
+	tune(&parallel_for_settings::thread_count, { size_t(hardware_concurrency), size_t(hardware_concurrency * 4 / 3), size_t(hardware_concurrency * 3 / 2), size_t(hardware_concurrency * 2) });
+	tune(&parallel_for_settings::max_size, { 16, 32, 64, 128 });
+	tune(&parallel_for_settings::split_size, { 2, 4, 8, 16 });
+	defaults = best;
+	return best;
+}
+
+// reuses the settings cached at path when present, otherwise tunes and writes them there
+inline parallel_for_settings autotune_parallel_for(const char* path, int width, int height, auto&& tile_func, int repetitions = 3)
+{
+	parallel_for_settings settings;
+	if (load_parallel_for_settings(path, settings))
+	{
+		parallel_for_defaults() = settings;
+		return settings;
+	}
+	settings = autotune_parallel_for(width, height, tile_func, repetitions);
+	save_parallel_for_settings(path, settings);
+	return settings;
+}
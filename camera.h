@@ -0,0 +1,161 @@
+#pragma once
+#include "parallel_for.h"
+#include "animation.h"
+#include "sampler.h"
+#include <cmath>
+#include <numbers>
+
+// camera space looks down -z with +y up, the camera_to_world keys sit at time 0 and 1 and
+// rays sample times between shutter_open and shutter_close, lens_radius 0 is a pinhole and
+// otherwise everything at focus_distance stays sharp
+struct camera
+{
+	animated<luc::AffineT<float>> camera_to_world;
+	float vertical_fov = 1.f;
+	float lens_radius = 0.f;
+	float focus_distance = 1.f;
+	float shutter_open = 0.f;
+	float shutter_close = 1.f;
+	camera() = default;
+	camera(const luc::AffineT<float>& _camera_to_world, float _vertical_fov) : camera_to_world(_camera_to_world, _camera_to_world), vertical_fov(_vertical_fov) {}
+	camera(const animated<luc::AffineT<float>>& _camera_to_world, float _vertical_fov) : camera_to_world(_camera_to_world), vertical_fov(_vertical_fov) {}
+	bool moving() const
+	{
+		return camera_to_world.t0.E != camera_to_world.t1.E;
+	}
+};
+
+// one primary ray per visited pixel of a tile, structure of arrays so every pass over it is a
+// plain loop over floats, the buffers only grow so a worker can reuse one for every tile
+struct camera_rays
+{
+	std::vector<float> ox, oy, oz;
+	std::vector<float> dx, dy, dz;
+	std::vector<float> time;
+	std::vector<float> screen_x, screen_y, lens_u, lens_v;
+	std::vector<int> x, y;
+	size_t size = 0;
+	void reserve(size_t capacity)
+	{
+		if (x.size() >= capacity)
+			return;
+		for (auto* v : { &ox, &oy, &oz, &dx, &dy, &dz, &time, &screen_x, &screen_y, &lens_u, &lens_v })
+			v->resize(capacity);
+		x.resize(capacity);
+		y.resize(capacity);
+	}
+};
+
+// the passes take their streams as __restrict parameters, through the vectors the compiler would
+// have to prove a dozen arrays disjoint at run time and it gives up on vectorizing instead
+inline void camera_space_rays(size_t count, const camera& view, float scale_x, float scale_y, const float* __restrict screen_x, const float* __restrict screen_y, const float* __restrict lens_u, const float* __restrict lens_v, float* __restrict ox, float* __restrict oy, float* __restrict oz, float* __restrict dx, float* __restrict dy, float* __restrict dz, float* __restrict time)
+{
+	const auto focus = view.focus_distance;
+	const auto radius = view.lens_radius;
+	const auto shutter_open = view.shutter_open;
+	const auto shutter_length = view.shutter_close - view.shutter_open;
+	const auto quarter_pi = std::numbers::pi_v<float> / 4.f;
+	for (size_t i = 0; i < count; i++)
+	{
+		// concentric disk mapping of the lens sample
+		const auto a = 2.f * lens_u[i] - 1.f;
+		const auto b = 2.f * lens_v[i] - 1.f;
+		const auto wide = std::abs(a) > std::abs(b);
+		const auto r = luc::Select(wide, a, b);
+		const auto phi = luc::Select(wide, quarter_pi * b / luc::Select(a == 0.f, 1.f, a), 2.f * quarter_pi - quarter_pi * a / luc::Select(b == 0.f, 1.f, b));
+		const auto [sin_phi, cos_phi] = luc::SinCos(phi);
+		const auto lens_x = radius * r * cos_phi;
+		const auto lens_y = radius * r * sin_phi;
+		ox[i] = lens_x;
+		oy[i] = lens_y;
+		oz[i] = 0.f;
+		dx[i] = screen_x[i] * scale_x * focus - lens_x;
+		dy[i] = -screen_y[i] * scale_y * focus - lens_y;
+		dz[i] = -focus;
+		time[i] = shutter_open + time[i] * shutter_length;
+	}
+}
+
+// the matrix lives in scalars and every stream is loaded and stored exactly once per ray, loads
+// through the transform or stores through references would count as more arrays that might
+// alias the ray streams
+inline void transform_rays(size_t count, const luc::AffineT<float>& transform, float* __restrict ox, float* __restrict oy, float* __restrict oz, float* __restrict dx, float* __restrict dy, float* __restrict dz)
+{
+	const auto m = transform.E;
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto px = ox[i], py = oy[i], pz = oz[i];
+		const auto vx = dx[i], vy = dy[i], vz = dz[i];
+		const auto tx = m[0] * vx + m[3] * vy + m[6] * vz;
+		const auto ty = m[1] * vx + m[4] * vy + m[7] * vz;
+		const auto tz = m[2] * vx + m[5] * vy + m[8] * vz;
+		const auto inverse_length = luc::Rsqrt(tx * tx + ty * ty + tz * tz);
+		ox[i] = m[0] * px + m[3] * py + m[6] * pz + m[9];
+		oy[i] = m[1] * px + m[4] * py + m[7] * pz + m[10];
+		oz[i] = m[2] * px + m[5] * py + m[8] * pz + m[11];
+		dx[i] = tx * inverse_length;
+		dy[i] = ty * inverse_length;
+		dz[i] = tz * inverse_length;
+	}
+}
+
+inline void transform_rays(size_t count, const animated<luc::AffineT<float>>& transform, const float* __restrict time, float* __restrict ox, float* __restrict oy, float* __restrict oz, float* __restrict dx, float* __restrict dy, float* __restrict dz)
+{
+	const auto m0 = transform.t0.E;
+	const auto m1 = transform.t1.E;
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto t = time[i];
+		std::array<float, 12> m;
+		for (size_t j = 0; j < 12; j++)
+		{
+			m[j] = luc::Lerp(t, m0[j], m1[j]);
+		}
+		const auto px = ox[i], py = oy[i], pz = oz[i];
+		const auto vx = dx[i], vy = dy[i], vz = dz[i];
+		const auto tx = m[0] * vx + m[3] * vy + m[6] * vz;
+		const auto ty = m[1] * vx + m[4] * vy + m[7] * vz;
+		const auto tz = m[2] * vx + m[5] * vy + m[8] * vz;
+		const auto inverse_length = luc::Rsqrt(tx * tx + ty * ty + tz * tz);
+		ox[i] = m[0] * px + m[3] * py + m[6] * pz + m[9];
+		oy[i] = m[1] * px + m[4] * py + m[7] * pz + m[10];
+		oz[i] = m[2] * px + m[5] * py + m[8] * pz + m[11];
+		dx[i] = tx * inverse_length;
+		dy[i] = ty * inverse_length;
+		dz[i] = tz * inverse_length;
+	}
+}
+
+// fills rays with sample number sample of every pixel in the tile, film, lens and time come
+// from sampler dimensions 0, 1 and 2, directions are normalized
+template<typename TSize>
+void generate_camera_rays(const work_block<TSize>& block, const camera& view, const sampler& source, uint32_t sample, camera_rays& rays)
+{
+	const auto& tile = block.tile;
+	const auto stride = tile.stride;
+	rays.reserve(size_t((tile.maxx - tile.minx + stride - 1) / stride) * size_t((tile.maxy - tile.miny + stride - 1) / stride));
+	size_t count = 0;
+	iterate_over_tile(block, [&](TSize x, TSize y, auto&& transform)
+	{
+		const auto film = source.get_2d(uint32_t(x), uint32_t(y), sample, 0);
+		const auto lens = source.get_2d(uint32_t(x), uint32_t(y), sample, 1);
+		const auto screen = transform(film.x - .5f, film.y - .5f);
+		rays.x[count] = int(x);
+		rays.y[count] = int(y);
+		rays.screen_x[count] = screen.x;
+		rays.screen_y[count] = screen.y;
+		rays.lens_u[count] = lens.x;
+		rays.lens_v[count] = lens.y;
+		rays.time[count] = source.get_1d(uint32_t(x), uint32_t(y), sample, 2);
+		count++;
+	});
+	rays.size = count;
+
+	const auto scale_y = 2.f * std::tan(view.vertical_fov * .5f);
+	const auto scale_x = scale_y * float(block.domain.maxx - block.domain.minx) / float(block.domain.maxy - block.domain.miny);
+	camera_space_rays(count, view, scale_x, scale_y, rays.screen_x.data(), rays.screen_y.data(), rays.lens_u.data(), rays.lens_v.data(), rays.ox.data(), rays.oy.data(), rays.oz.data(), rays.dx.data(), rays.dy.data(), rays.dz.data(), rays.time.data());
+	if (view.moving())
+		transform_rays(count, view.camera_to_world, rays.time.data(), rays.ox.data(), rays.oy.data(), rays.oz.data(), rays.dx.data(), rays.dy.data(), rays.dz.data());
+	else
+		transform_rays(count, view.camera_to_world.t0, rays.ox.data(), rays.oy.data(), rays.oz.data(), rays.dx.data(), rays.dy.data(), rays.dz.data());
+}
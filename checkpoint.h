@@ -0,0 +1,189 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct checkpoint_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t tile_size;
+	uint32_t bytes_per_pixel;
+	uint32_t tile_count;
+	uint32_t reserved;
+	uint64_t flags_offset;
+	uint64_t pixels_offset;
+};
+
+// a mapped snapshot of the framebuffer plus one completion flag per tile of the tiled domain, a
+// tile's pixels are stored before its flag so a killed process never resumes a half written tile
+template<typename TColor>
+struct checkpoint_file
+{
+	checkpoint_header header{};
+	int file = -1;
+	size_t file_size = 0;
+	uint8_t* mapping = nullptr;
+	bool resumed = false;
+
+	checkpoint_file() = default;
+	checkpoint_file(const checkpoint_file&) = delete;
+	checkpoint_file& operator=(const checkpoint_file&) = delete;
+	~checkpoint_file() { close(); }
+
+	bool open(const char* path, int width, int height, int tile_size)
+	{
+		close();
+		const auto tiles_x = (width + tile_size - 1) / tile_size;
+		const auto tiles_y = (height + tile_size - 1) / tile_size;
+		const auto tile_count = uint32_t(tiles_x * tiles_y);
+		const auto flags_offset = uint64_t(sizeof(checkpoint_header));
+		const auto pixels_offset = (flags_offset + tile_count + alignof(TColor) + 63) / 64 * 64;
+		header = { { 'L', 'C', 'K', 'P' }, 1, uint32_t(width), uint32_t(height), uint32_t(tile_size), uint32_t(sizeof(TColor)), tile_count, 0, flags_offset, pixels_offset };
+		file_size = pixels_offset + size_t(width) * size_t(height) * sizeof(TColor);
+		file = ::open(path, O_RDWR | O_CREAT, 0644);
+		if (file < 0)
+			return false;
+		checkpoint_header existing{};
+		resumed = pread(file, &existing, sizeof(existing), 0) == ssize_t(sizeof(existing)) && std::memcmp(&existing, &header, sizeof(header)) == 0;
+		if (!resumed && ftruncate(file, 0) != 0)
+		{
+			close();
+			return false;
+		}
+		if (ftruncate(file, off_t(file_size)) != 0)
+		{
+			close();
+			return false;
+		}
+		auto* address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (address == MAP_FAILED)
+		{
+			close();
+			return false;
+		}
+		mapping = static_cast<uint8_t*>(address);
+		if (!resumed)
+			std::memcpy(mapping, &header, sizeof(header));
+		return true;
+	}
+
+	void close()
+	{
+		if (mapping)
+		{
+			msync(mapping, file_size, MS_SYNC);
+			munmap(mapping, file_size);
+			mapping = nullptr;
+		}
+		if (file >= 0)
+		{
+			::close(file);
+			file = -1;
+		}
+	}
+
+	bool completed(size_t tile) const
+	{
+		return std::atomic_ref<uint8_t>(mapping[header.flags_offset + tile]).load(std::memory_order_acquire) != 0;
+	}
+
+	TColor* pixels() const
+	{
+		return reinterpret_cast<TColor*>(mapping + header.pixels_offset);
+	}
+
+	void store(framebuffer<TColor>& framebuffer, size_t tile, const work_range<int>& range)
+	{
+		for (auto y = range.miny; y < range.maxy; y++)
+		{
+			const auto offset = range.minx + y * framebuffer.width;
+			std::copy_n(framebuffer.pixels.begin() + offset, range.maxx - range.minx, pixels() + offset);
+		}
+		std::atomic_ref<uint8_t>(mapping[header.flags_offset + tile]).store(1, std::memory_order_release);
+	}
+
+	void restore(framebuffer<TColor>& framebuffer, const work_range<int>& range) const
+	{
+		for (auto y = range.miny; y < range.maxy; y++)
+		{
+			const auto offset = range.minx + y * framebuffer.width;
+			std::copy_n(pixels() + offset, range.maxx - range.minx, framebuffer.pixels.begin() + offset);
+		}
+	}
+
+	void flush(bool wait)
+	{
+		msync(mapping, file_size, wait ? MS_SYNC : MS_ASYNC);
+	}
+};
+
+// renders the tiles the checkpoint at path has not seen yet, snapshots are flushed every
+// flush_interval seconds by a side thread while workers keep going, returns true once complete
+template<typename TColor>
+bool render_checkpointed(framebuffer<TColor>& framebuffer, const char* path, auto&& tile_func, abort_token& aborter, double flush_interval = 60.0, int tile_size = 32)
+{
+	checkpoint_file<TColor> checkpoint;
+	if (!checkpoint.open(path, framebuffer.width, framebuffer.height, tile_size))
+		return false;
+	const auto tiles = generate_tiled_domain(framebuffer.width, framebuffer.height, tile_size);
+	const auto tiles_x = (framebuffer.width + tile_size - 1) / tile_size;
+	auto domain = tiles;
+	domain.ranges.clear();
+	auto remaining = std::make_unique<std::atomic<int>[]>(tiles.ranges.size());
+	for (size_t i = 0; i < tiles.ranges.size(); i++)
+	{
+		const auto& range = tiles.ranges[i];
+		if (checkpoint.resumed && checkpoint.completed(i))
+		{
+			checkpoint.restore(framebuffer, range);
+			continue;
+		}
+		remaining[i] = (range.maxx - range.minx) * (range.maxy - range.miny);
+		domain.ranges.push_back(range);
+	}
+
+	std::mutex flush_mutex;
+	std::condition_variable flush_signal;
+	bool finished = false;
+	std::thread flusher([&]()
+	{
+		std::unique_lock lock(flush_mutex);
+		const auto interval = std::chrono::duration<double>(flush_interval);
+		while (!flush_signal.wait_for(lock, interval, [&]() { return finished; }))
+		{
+			checkpoint.flush(false);
+		}
+	});
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		tile_func(block);
+		const auto tile = size_t(block.tile.minx / tile_size + (block.tile.miny / tile_size) * tiles_x);
+		const auto area = (block.tile.maxx - block.tile.minx) * (block.tile.maxy - block.tile.miny);
+		if (remaining[tile].fetch_sub(area) == area)
+			checkpoint.store(framebuffer, tile, tiles.ranges[tile]);
+	}, aborter);
+	{
+		std::scoped_lock lock(flush_mutex);
+		finished = true;
+	}
+	flush_signal.notify_one();
+	flusher.join();
+	checkpoint.flush(true);
+	for (size_t i = 0; i < tiles.ranges.size(); i++)
+	{
+		if (!checkpoint.completed(i))
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,297 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+enum class lease_message : uint32_t
+{
+	request,
+	lease,
+	result,
+	done,
+};
+
+struct lease_header
+{
+	lease_message type;
+	int32_t id;
+	int32_t minx, maxx, miny, maxy;
+	int32_t width, height;
+	uint64_t bytes;
+};
+
+inline bool send_all(int socket, const void* data, size_t size)
+{
+	auto* bytes = static_cast<const uint8_t*>(data);
+	while (size > 0)
+	{
+		const auto sent = ::send(socket, bytes, size, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= size_t(sent);
+	}
+	return true;
+}
+
+inline bool receive_all(int socket, void* data, size_t size)
+{
+	auto* bytes = static_cast<uint8_t*>(data);
+	while (size > 0)
+	{
+		const auto received = ::recv(socket, bytes, size, 0);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= size_t(received);
+	}
+	return true;
+}
+
+inline bool make_socket_address(const char* path, sockaddr_un& address)
+{
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path))
+		return false;
+	std::strcpy(address.sun_path, path);
+	return true;
+}
+
+// hands out grid tiles to worker processes connected over a unix socket and assembles the returned
+// pixels, leases that outlive lease_timeout or belong to a dropped worker go back to the queue and
+// idle workers speculatively take over the oldest outstanding lease at the end of the frame
+template<typename TColor>
+bool render_distributed(framebuffer<TColor>& framebuffer, const char* socket_path, abort_token& aborter, int lease_size = 64, double lease_timeout = 10.0)
+{
+	using clock = std::chrono::steady_clock;
+	struct lease_client
+	{
+		int socket;
+		int lease = -1;
+		bool waiting = false;
+	};
+	const auto domain = generate_tiled_domain(framebuffer.width, framebuffer.height, lease_size);
+	const auto tile_count = int(domain.ranges.size());
+	std::vector<uint8_t> completed(tile_count, 0);
+	std::vector<int> lease_count(tile_count, 0);
+	std::vector<clock::time_point> leased_at(tile_count);
+	std::deque<int> pending;
+	for (int i = 0; i < tile_count; i++)
+		pending.push_back(i);
+	auto remaining = tile_count;
+
+	sockaddr_un address;
+	const auto listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || !make_socket_address(socket_path, address))
+		return false;
+	::unlink(socket_path);
+	if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 64) != 0)
+	{
+		::close(listener);
+		return false;
+	}
+	std::vector<lease_client> clients;
+
+	auto next_lease = [&](int client) -> int
+	{
+		while (!pending.empty())
+		{
+			const auto id = pending.front();
+			pending.pop_front();
+			if (!completed[id])
+				return id;
+		}
+		int oldest = -1;
+		for (int id = 0; id < tile_count; id++)
+		{
+			if (completed[id] || lease_count[id] >= 2 || id == clients[client].lease)
+				continue;
+			if (oldest < 0 || leased_at[id] < leased_at[oldest])
+				oldest = id;
+		}
+		return oldest;
+	};
+	auto send_lease = [&](int client) -> bool
+	{
+		const auto id = next_lease(client);
+		clients[client].waiting = id < 0;
+		clients[client].lease = id;
+		if (id < 0)
+			return true;
+		lease_count[id]++;
+		leased_at[id] = clock::now();
+		const auto& range = domain.ranges[id];
+		const lease_header header{ lease_message::lease, id, range.minx, range.maxx, range.miny, range.maxy, framebuffer.width, framebuffer.height, 0 };
+		return send_all(clients[client].socket, &header, sizeof(header));
+	};
+	auto drop = [&](size_t client)
+	{
+		const auto id = clients[client].lease;
+		if (id >= 0 && !completed[id])
+		{
+			lease_count[id]--;
+			pending.push_front(id);
+		}
+		::close(clients[client].socket);
+		clients.erase(clients.begin() + client);
+	};
+	auto receive = [&](size_t client) -> bool
+	{
+		lease_header header;
+		if (!receive_all(clients[client].socket, &header, sizeof(header)))
+			return false;
+		if (header.type == lease_message::result)
+		{
+			if (header.id < 0 || header.id >= tile_count)
+				return false;
+			const auto& range = domain.ranges[header.id];
+			const auto width = range.maxx - range.minx;
+			const auto height = range.maxy - range.miny;
+			if (header.bytes != uint64_t(width) * height * sizeof(TColor))
+				return false;
+			std::vector<TColor> pixels(size_t(width) * height);
+			if (!receive_all(clients[client].socket, pixels.data(), header.bytes))
+				return false;
+			if (!completed[header.id])
+			{
+				for (int y = 0; y < height; y++)
+					std::copy_n(pixels.begin() + y * width, width, framebuffer.pixels.begin() + (range.minx + (range.miny + y) * framebuffer.width));
+				completed[header.id] = 1;
+				remaining--;
+			}
+			lease_count[header.id]--;
+		}
+		clients[client].lease = -1;
+		return send_lease(int(client));
+	};
+
+	const auto timeout = std::chrono::duration<double>(lease_timeout);
+	while (remaining > 0 && !aborter.aborted)
+	{
+		std::vector<pollfd> fds{ { listener, POLLIN, 0 } };
+		for (const auto& client : clients)
+			fds.push_back({ client.socket, POLLIN, 0 });
+		::poll(fds.data(), fds.size(), 100);
+		if (fds[0].revents & POLLIN)
+		{
+			const auto socket = ::accept(listener, nullptr, nullptr);
+			if (socket >= 0)
+			{
+				const timeval receive_timeout{ time_t(lease_timeout), 0 };
+				::setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+				clients.push_back({ socket });
+			}
+		}
+		for (size_t i = fds.size() - 1; i > 0; i--)
+		{
+			if (fds[i].revents && !receive(i - 1))
+				drop(i - 1);
+		}
+		const auto now = clock::now();
+		for (int id = 0; id < tile_count; id++)
+		{
+			if (!completed[id] && lease_count[id] > 0 && now - leased_at[id] > timeout)
+			{
+				leased_at[id] = now;
+				pending.push_back(id);
+			}
+		}
+		for (size_t i = clients.size(); i > 0; i--)
+		{
+			if (clients[i - 1].waiting && !send_lease(int(i - 1)))
+				drop(i - 1);
+		}
+	}
+	const lease_header done{ lease_message::done, -1, 0, 0, 0, 0, 0, 0, 0 };
+	for (const auto& client : clients)
+	{
+		send_all(client.socket, &done, sizeof(done));
+		::close(client.socket);
+	}
+	::close(listener);
+	::unlink(socket_path);
+	return remaining == 0;
+}
+
+// connects to a coordinator and renders leased tiles until told to stop, tile_func(block, tile)
+// writes the pixels of block into tile, a framebuffer_tile covering the whole lease
+template<typename TColor>
+bool run_tile_worker(const char* socket_path, auto&& tile_func, abort_token& aborter, int connect_attempts = 50)
+{
+	sockaddr_un address;
+	if (!make_socket_address(socket_path, address))
+		return false;
+	int socket = -1;
+	for (int attempt = 0; attempt < connect_attempts && socket < 0 && !aborter.aborted; attempt++)
+	{
+		socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (::connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			::close(socket);
+			socket = -1;
+			::usleep(100000);
+		}
+	}
+	if (socket < 0)
+		return false;
+	lease_header request{ lease_message::request, -1, 0, 0, 0, 0, 0, 0, 0 };
+	auto ok = send_all(socket, &request, sizeof(request));
+	framebuffer_tile<TColor> tile;
+	lease_header header{};
+	while (ok && !aborter.aborted && receive_all(socket, &header, sizeof(header)) && header.type == lease_message::lease)
+	{
+		tile.reset(header.minx, header.miny, header.maxx - header.minx, header.maxy - header.miny);
+		auto domain = generate_parallel_for_domain(header.minx, header.maxx, header.miny, header.maxy);
+		domain.range = work_range<int>(0, header.width, 0, header.height);
+		parallel_for(domain, [&](const work_block<int>& block) { tile_func(block, tile); }, aborter);
+		// a partly rendered tile is never sent, closing the socket hands the lease back to the queue
+		if (aborter.aborted)
+			break;
+		const lease_header result{ lease_message::result, header.id, header.minx, header.maxx, header.miny, header.maxy, header.width, header.height, tile.pixels.size() * sizeof(TColor) };
+		ok = send_all(socket, &result, sizeof(result)) && send_all(socket, tile.pixels.data(), result.bytes);
+	}
+	// a late result can race the coordinator shutting down, its done message is still queued for us
+	if (!ok)
+		ok = receive_all(socket, &header, sizeof(header));
+	::close(socket);
+	return ok && header.type == lease_message::done;
+}
+
+// renders framebuffer with process_count forked worker processes on this machine, the calling
+// process is the coordinator, call it before any other threads are started since fork only
+// carries over the calling thread, workers still retrying to connect once the frame is done
+// are stopped
+template<typename TColor>
+bool render_distributed_local(framebuffer<TColor>& framebuffer, const char* socket_path, int process_count, auto&& tile_func, abort_token& aborter, int lease_size = 64, double lease_timeout = 10.0)
+{
+	std::vector<pid_t> workers;
+	for (int i = 0; i < process_count; i++)
+	{
+		const auto pid = ::fork();
+		if (pid == 0)
+		{
+			abort_token worker_aborter;
+			const auto ok = run_tile_worker<TColor>(socket_path, tile_func, worker_aborter);
+			::_exit(ok ? 0 : 1);
+		}
+		if (pid > 0)
+			workers.push_back(pid);
+	}
+	const auto ok = !workers.empty() && render_distributed(framebuffer, socket_path, aborter, lease_size, lease_timeout);
+	for (const auto pid : workers)
+	{
+		::kill(pid, SIGTERM);
+		::waitpid(pid, nullptr, 0);
+	}
+	return ok;
+}
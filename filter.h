@@ -0,0 +1,148 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include <cmath>
+#include <limits>
+
+struct box_filter
+{
+	float radius = .5f;
+	float evaluate(float, float) const
+	{
+		return 1.f;
+	}
+};
+
+struct gaussian_filter
+{
+	float radius = 1.5f;
+	float alpha = 2.f;
+	float evaluate(float dx, float dy) const
+	{
+		const auto edge = std::exp(-alpha * radius * radius);
+		const auto gaussian = [&](float d) { return std::max(0.f, std::exp(-alpha * d * d) - edge); };
+		return gaussian(dx) * gaussian(dy);
+	}
+};
+
+struct mitchell_filter
+{
+	float radius = 2.f;
+	float b = 1.f / 3.f;
+	float c = 1.f / 3.f;
+	float evaluate(float dx, float dy) const
+	{
+		return mitchell(2.f * dx / radius) * mitchell(2.f * dy / radius);
+	}
+	float mitchell(float x) const
+	{
+		x = std::abs(x);
+		if (x >= 2.f)
+			return 0.f;
+		if (x >= 1.f)
+			return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6.f;
+		return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6.f;
+	}
+};
+
+template<typename TColor>
+struct splat_sample
+{
+	TColor sum;
+	float weight;
+};
+
+// owned by one tile and covers it plus the filter apron, so splats never touch shared memory
+template<typename TColor, typename TFilter>
+struct splat_tile
+{
+	framebuffer_tile<splat_sample<TColor>> samples;
+	const TFilter* filter = nullptr;
+	void reset(const work_range<int>& region, const TFilter& _filter)
+	{
+		filter = &_filter;
+		samples.reset(region.minx, region.miny, region.maxx - region.minx, region.maxy - region.miny);
+		std::fill(samples.pixels.begin(), samples.pixels.end(), splat_sample<TColor>{ TColor(0.f), 0.f });
+	}
+	// px, py are continuous raster coordinates, pixel centers sit at x + .5
+	void splat(float px, float py, const TColor& value)
+	{
+		const auto minx = std::max(int(std::ceil(px - .5f - filter->radius)), samples.minx);
+		const auto miny = std::max(int(std::ceil(py - .5f - filter->radius)), samples.miny);
+		const auto maxx = std::min(int(std::floor(px - .5f + filter->radius)), samples.minx + samples.width - 1);
+		const auto maxy = std::min(int(std::floor(py - .5f + filter->radius)), samples.miny + samples.height - 1);
+		for (auto y = miny; y <= maxy; y++)
+		{
+			for (auto x = minx; x <= maxx; x++)
+			{
+				const auto weight = filter->evaluate(x + .5f - px, y + .5f - py);
+				auto& sample = samples.pixel(x, y);
+				sample.sum = sample.sum + value * weight;
+				sample.weight += weight;
+			}
+		}
+	}
+	// u, v in [-.5, .5] around the center of pixel x, y as used by iterate_over_tile
+	void splat(int x, int y, float u, float v, const TColor& value)
+	{
+		splat(x + .5f + u, y + .5f + v, value);
+	}
+};
+
+template<typename TColor, typename TFilter>
+void render_splatted(framebuffer<TColor>& framebuffer, const TFilter& filter, auto&& tile_func, abort_token& aborter, int tile_size = 32)
+{
+	auto domain = generate_tiled_domain(framebuffer.width, framebuffer.height, tile_size);
+	domain.split_size = std::numeric_limits<int>::max();
+	const auto apron = int(std::ceil(filter.radius));
+	const auto tiles_x = (framebuffer.width + tile_size - 1) / tile_size;
+	const auto tiles_y = (framebuffer.height + tile_size - 1) / tile_size;
+	const auto tile_index = [&](const work_range<int>& range) { return range.minx / tile_size + (range.miny / tile_size) * tiles_x; };
+	std::vector<splat_tile<TColor, TFilter>> tiles(domain.ranges.size());
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		auto& tile = tiles[tile_index(block.tile)];
+		const work_range<int> region(std::max(block.tile.minx - apron, 0), std::min(block.tile.maxx + apron, framebuffer.width), std::max(block.tile.miny - apron, 0), std::min(block.tile.maxy + apron, framebuffer.height));
+		tile.reset(region, filter);
+		tile_func(block, tile);
+	}, aborter);
+	if (aborter.aborted)
+		return;
+	// every pixel gathers its neighbours' aprons in the same order, independent of thread timing
+	const auto reach = (apron + tile_size - 1) / tile_size;
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		thread_local framebuffer_tile<splat_sample<TColor>> gathered;
+		const auto& range = block.tile;
+		gathered.reset(range.minx, range.miny, range.maxx - range.minx, range.maxy - range.miny);
+		std::fill(gathered.pixels.begin(), gathered.pixels.end(), splat_sample<TColor>{ TColor(0.f), 0.f });
+		const auto tx = range.minx / tile_size, ty = range.miny / tile_size;
+		for (auto ny = std::max(ty - reach, 0); ny <= std::min(ty + reach, tiles_y - 1); ny++)
+		{
+			for (auto nx = std::max(tx - reach, 0); nx <= std::min(tx + reach, tiles_x - 1); nx++)
+			{
+				const auto& samples = tiles[nx + ny * tiles_x].samples;
+				const auto minx = std::max(range.minx, samples.minx), maxx = std::min(range.maxx, samples.minx + samples.width);
+				const auto miny = std::max(range.miny, samples.miny), maxy = std::min(range.maxy, samples.miny + samples.height);
+				for (auto y = miny; y < maxy; y++)
+				{
+					for (auto x = minx; x < maxx; x++)
+					{
+						const auto& sample = samples.pixel(x, y);
+						auto& target = gathered.pixel(x, y);
+						target.sum = target.sum + sample.sum;
+						target.weight += sample.weight;
+					}
+				}
+			}
+		}
+		for (auto y = range.miny; y < range.maxy; y++)
+		{
+			for (auto x = range.minx; x < range.maxx; x++)
+			{
+				const auto& sample = gathered.pixel(x, y);
+				framebuffer.pixel(x, y) = sample.weight > 0.f ? TColor(sample.sum * (1.f / sample.weight)) : TColor(0.f);
+			}
+		}
+	}, aborter);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include <algorithm>
+#include <limits>
+
+inline int stride_for_priority(float priority)
+{
+	if (priority >= .5f)
+		return 1;
+	if (priority >= .25f)
+		return 2;
+	return 4;
+}
+
+// priority(range) in [0, 1] decides both the order tiles are handed out in and their pixel stride,
+// tiles are grid aligned so strided tiles stay on their stride grid when parallel_for splits them
+template<typename TSize>
+work_domain<TSize> generate_prioritized_domain(TSize width, TSize height, auto&& priority, TSize tile_size = 32)
+{
+	auto domain = generate_tiled_domain(width, height, tile_size);
+	std::vector<std::pair<float, work_range<TSize>>> ranked;
+	ranked.reserve(domain.ranges.size());
+	for (auto range : domain.ranges)
+	{
+		const auto p = priority(range);
+		range.stride = stride_for_priority(p);
+		ranked.emplace_back(p, range);
+	}
+	std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+	for (size_t i = 0; i < ranked.size(); i++)
+	{
+		domain.ranges[i] = ranked[i].second;
+	}
+	return domain;
+}
+
+// fills every stride x stride block from the pixel iterate_over_tile rendered at its corner
+template<typename TColor, typename TSize>
+void upsample_strided(framebuffer<TColor>& framebuffer, const work_domain<TSize>& domain, abort_token& aborter)
+{
+	work_domain<TSize> coarse(domain.range.minx, domain.range.maxx, domain.range.miny, domain.range.maxy);
+	for (const auto& range : domain.ranges)
+	{
+		if (range.stride > 1)
+			coarse.ranges.push_back(range);
+	}
+	coarse.split_size = std::numeric_limits<TSize>::max();
+	parallel_for(coarse, [&](const work_block<TSize>& block)
+	{
+		const auto& tile = block.tile;
+		for (auto y = tile.miny; y < tile.maxy; y++)
+		{
+			const auto sy = tile.miny + (y - tile.miny) / tile.stride * tile.stride;
+			for (auto x = tile.minx; x < tile.maxx; x++)
+			{
+				const auto sx = tile.minx + (x - tile.minx) / tile.stride * tile.stride;
+				framebuffer.pixel(x, y) = framebuffer.pixel(sx, sy);
+			}
+		}
+	}, aborter);
+}
+
+// halves the stride of every coarse tile and drops finished ones, returns false once all are full
+// rate, the old stride becomes coarse_stride so iterate_over_tile only visits the new points
+template<typename TSize>
+bool refine_domain(work_domain<TSize>& domain)
+{
+	std::erase_if(domain.ranges, [](const work_range<TSize>& range) { return range.stride <= 1; });
+	for (auto& range : domain.ranges)
+	{
+		range.coarse_stride = range.stride;
+		range.stride /= 2;
+	}
+	return !domain.ranges.empty();
+}
+
+template<typename TColor>
+work_domain<int> render_foveated(framebuffer<TColor>& framebuffer, auto&& priority, auto&& tile_func, abort_token& aborter)
+{
+	const auto domain = generate_prioritized_domain(framebuffer.width, framebuffer.height, priority);
+	parallel_for(domain, tile_func, aborter);
+	upsample_strided(framebuffer, domain, aborter);
+	return domain;
+}
+
+template<typename TColor>
+bool refine_foveated(framebuffer<TColor>& framebuffer, work_domain<int>& domain, auto&& tile_func, abort_token& aborter)
+{
+	if (!refine_domain(domain))
+		return false;
+	parallel_for(domain, tile_func, aborter);
+	upsample_strided(framebuffer, domain, aborter);
+	return true;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "lucmath.h"
 #include <vector>
 
 template<typename TColor>
@@ -15,4 +16,46 @@ struct framebuffer
 	{
 		return pixels[x + y * width];
 	}
+};
+
+template<typename TColor>
+struct framebuffer_tile
+{
+	int minx = 0, miny = 0, width = 0, height = 0;
+	std::vector<TColor> pixels;
+	framebuffer_tile() = default;
+	framebuffer_tile(int _minx, int _miny, int _width, int _height)
+	{
+		reset(_minx, _miny, _width, _height);
+	}
+	void reset(int _minx, int _miny, int _width, int _height)
+	{
+		minx = _minx;
+		miny = _miny;
+		width = _width;
+		height = _height;
+		pixels.resize(width * height);
+	}
+	TColor& pixel(int x, int y)
+	{
+		return pixels[(x - minx) + (y - miny) * width];
+	}
+	const TColor& pixel(int x, int y) const
+	{
+		return pixels[(x - minx) + (y - miny) * width];
+	}
+};
+
+template<typename TColor>
+struct pixel_traits
+{
+	static constexpr size_t channels = 1;
+	static float channel(const TColor& color, size_t) { return float(color); }
+};
+
+template<typename T, size_t N>
+struct pixel_traits<luc::VectorTN<T, N>>
+{
+	static constexpr size_t channels = N;
+	static float channel(const luc::VectorTN<T, N>& color, size_t i) { return float(color.E[i]); }
 };
\ No newline at end of file
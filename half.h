@@ -0,0 +1,40 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+// bitwise select, with ?: the compiler sinks the float math of the unused case into a branch and
+// then cannot vectorize it
+inline uint32_t select_bits(bool condition, uint32_t a, uint32_t b)
+{
+	const auto mask = 0u - uint32_t(condition);
+	return (a & mask) | (b & ~mask);
+}
+
+// round-to-nearest-even conversion, handles denormals, infinities and nans, every case is
+// computed and the result picked with select_bits so loops over it vectorize
+inline uint16_t float_to_half(float value)
+{
+	const uint32_t f32_infinity = 255u << 23;
+	const uint32_t f16_max = (127u + 16u) << 23;
+	const uint32_t denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+	auto bits = std::bit_cast<uint32_t>(value);
+	const auto sign = bits & 0x80000000u;
+	bits ^= sign;
+	const auto overflow = select_bits(bits > f32_infinity, 0x7e00u, 0x7c00u);
+	const auto denorm = std::bit_cast<uint32_t>(std::bit_cast<float>(bits) + std::bit_cast<float>(denorm_magic)) - denorm_magic;
+	const auto normal = (bits + ((15u - 127u) << 23) + 0xfffu + ((bits >> 13) & 1u)) >> 13;
+	const auto result = select_bits(bits >= f16_max, overflow, select_bits(bits < (113u << 23), denorm, normal));
+	return uint16_t(result | (sign >> 16));
+}
+
+inline float half_to_float(uint16_t value)
+{
+	const uint32_t shifted_exponent = 0x7c00u << 13;
+	const float magic = std::bit_cast<float>(113u << 23);
+	const auto bits = (uint32_t(value & 0x7fffu) << 13) + ((127u - 15u) << 23);
+	const auto exponent = shifted_exponent & (uint32_t(value) << 13);
+	const auto special = bits + ((128u - 16u) << 23);
+	const auto denorm = std::bit_cast<uint32_t>(std::bit_cast<float>(bits + (1u << 23)) - magic);
+	const auto result = select_bits(exponent == shifted_exponent, special, select_bits(exponent == 0, denorm, bits));
+	return std::bit_cast<float>(result | (uint32_t(value & 0x8000u) << 16));
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include "half.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+struct byte_writer
+{
+	std::vector<uint8_t> bytes;
+	template<typename T>
+	void put(const T& value)
+	{
+		const auto offset = bytes.size();
+		bytes.resize(offset + sizeof(T));
+		std::memcpy(bytes.data() + offset, &value, sizeof(T));
+	}
+	void put(const std::string& text)
+	{
+		bytes.insert(bytes.end(), text.begin(), text.end());
+	}
+	void put_name(const char* name)
+	{
+		put(std::string(name));
+		put(uint8_t(0));
+	}
+};
+
+inline bool write_file(const char* path, const std::vector<uint8_t>& bytes)
+{
+	auto* file = std::fopen(path, "wb");
+	if (!file)
+		return false;
+	const auto written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+	return std::fclose(file) == 0 && written == bytes.size();
+}
+
+inline uint8_t tonemap_to_byte(float value)
+{
+	value = luc::Clamp(value, 0.f, 1.f);
+	const auto srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+	return uint8_t(srgb * 255.f + .5f);
+}
+
+// converts pixels tile by tile straight into the file image, encode_pixel(bytes, x, y, color)
+template<typename TColor>
+void encode_parallel(const framebuffer<TColor>& framebuffer, std::vector<uint8_t>& bytes, auto&& encode_pixel)
+{
+	abort_token aborter;
+	const auto domain = generate_parallel_for_domain(framebuffer.width, framebuffer.height);
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+		{
+			for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+			{
+				encode_pixel(bytes.data(), x, y, framebuffer.pixels[x + y * framebuffer.width]);
+			}
+		}
+	}, aborter);
+}
+
+template<typename TColor>
+bool write_pfm(const char* path, const framebuffer<TColor>& framebuffer)
+{
+	using traits = pixel_traits<TColor>;
+	const int channels = traits::channels == 1 ? 1 : 3;
+	byte_writer header;
+	header.put(std::string(channels == 1 ? "Pf\n" : "PF\n"));
+	header.put(std::to_string(framebuffer.width) + " " + std::to_string(framebuffer.height) + "\n-1.0\n");
+	auto bytes = std::move(header.bytes);
+	const auto offset = bytes.size();
+	bytes.resize(offset + size_t(framebuffer.width) * framebuffer.height * channels * sizeof(float));
+	encode_parallel(framebuffer, bytes, [&](uint8_t* data, int x, int y, const TColor& color)
+	{
+		const auto row = size_t(framebuffer.height - 1 - y);
+		auto* out = data + offset + (row * framebuffer.width + x) * channels * sizeof(float);
+		for (int c = 0; c < channels; c++)
+		{
+			const auto value = size_t(c) < traits::channels ? traits::channel(color, c) : 0.f;
+			std::memcpy(out + c * sizeof(float), &value, sizeof(float));
+		}
+	});
+	return write_file(path, bytes);
+}
+
+template<typename TColor>
+bool write_ppm(const char* path, const framebuffer<TColor>& framebuffer, float exposure = 1.f)
+{
+	using traits = pixel_traits<TColor>;
+	byte_writer header;
+	header.put("P6\n" + std::to_string(framebuffer.width) + " " + std::to_string(framebuffer.height) + "\n255\n");
+	auto bytes = std::move(header.bytes);
+	const auto offset = bytes.size();
+	bytes.resize(offset + size_t(framebuffer.width) * framebuffer.height * 3);
+	encode_parallel(framebuffer, bytes, [&](uint8_t* data, int x, int y, const TColor& color)
+	{
+		auto* out = data + offset + (size_t(y) * framebuffer.width + x) * 3;
+		for (size_t c = 0; c < 3; c++)
+		{
+			const auto value = c < traits::channels ? traits::channel(color, c) : traits::channel(color, 0);
+			out[c] = tonemap_to_byte(value * exposure);
+		}
+	});
+	return write_file(path, bytes);
+}
+
+// uncompressed half float scanline exr
+template<typename TColor>
+bool write_exr(const char* path, const framebuffer<TColor>& framebuffer)
+{
+	using traits = pixel_traits<TColor>;
+	static_assert(traits::channels >= 1 && traits::channels <= 4);
+	const char* names[4][4] = { { "Y" }, { "G", "R" }, { "B", "G", "R" }, { "A", "B", "G", "R" } };
+	const int sources[4][4] = { { 0 }, { 1, 0 }, { 2, 1, 0 }, { 3, 2, 1, 0 } };
+	const auto channels = int(traits::channels);
+	const auto* channel_names = names[channels - 1];
+	const auto* channel_sources = sources[channels - 1];
+	const auto width = framebuffer.width, height = framebuffer.height;
+
+	byte_writer header;
+	header.put(uint32_t(20000630));
+	header.put(uint32_t(2));
+	auto attribute = [&](const char* name, const char* type, int32_t size)
+	{
+		header.put_name(name);
+		header.put_name(type);
+		header.put(size);
+	};
+	int32_t channel_list_size = 1;
+	for (int c = 0; c < channels; c++)
+		channel_list_size += int32_t(std::strlen(channel_names[c])) + 1 + 16;
+	attribute("channels", "chlist", channel_list_size);
+	for (int c = 0; c < channels; c++)
+	{
+		header.put_name(channel_names[c]);
+		header.put(int32_t(1));
+		header.put(uint32_t(0));
+		header.put(int32_t(1));
+		header.put(int32_t(1));
+	}
+	header.put(uint8_t(0));
+	attribute("compression", "compression", 1);
+	header.put(uint8_t(0));
+	for (const auto* window : { "dataWindow", "displayWindow" })
+	{
+		attribute(window, "box2i", 16);
+		header.put(int32_t(0));
+		header.put(int32_t(0));
+		header.put(int32_t(width - 1));
+		header.put(int32_t(height - 1));
+	}
+	attribute("lineOrder", "lineOrder", 1);
+	header.put(uint8_t(0));
+	attribute("pixelAspectRatio", "float", 4);
+	header.put(1.f);
+	attribute("screenWindowCenter", "v2f", 8);
+	header.put(0.f);
+	header.put(0.f);
+	attribute("screenWindowWidth", "float", 4);
+	header.put(1.f);
+	header.put(uint8_t(0));
+
+	const auto line_size = size_t(width) * channels * sizeof(uint16_t);
+	const auto block_size = 2 * sizeof(int32_t) + line_size;
+	const auto blocks_offset = header.bytes.size() + size_t(height) * sizeof(uint64_t);
+	for (int y = 0; y < height; y++)
+		header.put(uint64_t(blocks_offset + y * block_size));
+	auto bytes = std::move(header.bytes);
+	bytes.resize(blocks_offset + height * block_size);
+	for (int y = 0; y < height; y++)
+	{
+		auto* block = bytes.data() + blocks_offset + y * block_size;
+		const int32_t block_header[2] = { y, int32_t(line_size) };
+		std::memcpy(block, block_header, sizeof(block_header));
+	}
+	encode_parallel(framebuffer, bytes, [&](uint8_t* data, int x, int y, const TColor& color)
+	{
+		auto* line = data + blocks_offset + y * block_size + 2 * sizeof(int32_t);
+		for (int c = 0; c < channels; c++)
+		{
+			const auto value = float_to_half(traits::channel(color, channel_sources[c]));
+			std::memcpy(line + (size_t(c) * width + x) * sizeof(uint16_t), &value, sizeof(uint16_t));
+		}
+	});
+	return write_file(path, bytes);
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "parallel_for.h"
+#include "reduce.h"
+#include "animation.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// a + t * (b - a) rather than luc::Lerp so instances whose keys are equal get them back exactly
+inline void lerp_stream(size_t count, float t, const float* __restrict a, const float* __restrict b, float* __restrict result)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		result[i] = a[i] + t * (b[i] - a[i]);
+	}
+}
+
+// one world axis of the transformed boxes, the center goes through the matrix row and the extent
+// through its absolute values, which bounds all eight transformed corners at once
+inline void transform_bounds_axis(size_t count, const float* __restrict row_x, const float* __restrict row_y, const float* __restrict row_z, const float* __restrict offset, const float* __restrict center_x, const float* __restrict center_y, const float* __restrict center_z, const float* __restrict extent_x, const float* __restrict extent_y, const float* __restrict extent_z, float* __restrict min, float* __restrict max)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto center = row_x[i] * center_x[i] + row_y[i] * center_y[i] + row_z[i] * center_z[i] + offset[i];
+		const auto extent = std::abs(row_x[i]) * extent_x[i] + std::abs(row_y[i]) * extent_y[i] + std::abs(row_z[i]) * extent_z[i];
+		min[i] = center - extent;
+		max[i] = center + extent;
+	}
+}
+
+// instance transforms as twelve float streams per key in AffineT::E order, object space bounds
+// as center and extent and world space bounds as min and max streams, update() only recomputes
+// instances marked dirty by a setter or by set_time
+struct instance_store
+{
+	using affine_streams = std::array<std::vector<float>, 12>;
+	using vector_streams = std::array<std::vector<float>, 3>;
+
+	affine_streams key0, key1, world;
+	vector_streams local_center, local_extent;
+	vector_streams world_min, world_max;
+	std::vector<uint8_t> moving, dirty;
+	std::vector<uint32_t> dirty_list;
+	float time = 0.f;
+
+	size_t size() const
+	{
+		return moving.size();
+	}
+
+	uint32_t add(const animated<luc::AffineT<float>>& transform, const luc::Bounds3& local_bounds)
+	{
+		const auto index = uint32_t(size());
+		for (auto* streams : { &key0, &key1, &world })
+		{
+			for (auto& stream : *streams)
+				stream.push_back(0.f);
+		}
+		for (auto* streams : { &local_center, &local_extent, &world_min, &world_max })
+		{
+			for (auto& stream : *streams)
+				stream.push_back(0.f);
+		}
+		moving.push_back(0);
+		dirty.push_back(0);
+		set_transform(index, transform);
+		set_bounds(index, local_bounds);
+		return index;
+	}
+
+	void set_transform(uint32_t index, const animated<luc::AffineT<float>>& transform)
+	{
+		for (size_t j = 0; j < 12; j++)
+		{
+			key0[j][index] = transform.t0.E[j];
+			key1[j][index] = transform.t1.E[j];
+		}
+		moving[index] = transform.t0.E != transform.t1.E;
+		mark_dirty(index);
+	}
+
+	void set_bounds(uint32_t index, const luc::Bounds3& local_bounds)
+	{
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			local_center[axis][index] = (local_bounds.max.E[axis] + local_bounds.min.E[axis]) * .5f;
+			local_extent[axis][index] = (local_bounds.max.E[axis] - local_bounds.min.E[axis]) * .5f;
+		}
+		mark_dirty(index);
+	}
+
+	void mark_dirty(uint32_t index)
+	{
+		if (dirty[index])
+			return;
+		dirty[index] = 1;
+		dirty_list.push_back(index);
+	}
+
+	// every moving instance becomes dirty, static ones keep their world transform and bounds
+	void set_time(float _time)
+	{
+		time = _time;
+		for (uint32_t i = 0; i < uint32_t(size()); i++)
+		{
+			if (moving[i])
+				mark_dirty(i);
+		}
+	}
+
+	luc::AffineT<float> transform(uint32_t index) const
+	{
+		std::array<luc::Vector3, 4> columns;
+		for (size_t c = 0; c < 4; c++)
+			columns[c] = luc::Vector3(world[3 * c][index], world[3 * c + 1][index], world[3 * c + 2][index]);
+		return luc::AffineT<float>(columns);
+	}
+
+	luc::Bounds3 bounds(uint32_t index) const
+	{
+		luc::Bounds3 result;
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			result.min.E[axis] = world_min[axis][index];
+			result.max.E[axis] = world_max[axis][index];
+		}
+		return result;
+	}
+
+	// recomputes world transforms and bounds of the dirty instances, when most of the store is
+	// dirty it runs the stream passes over contiguous chunks instead of following the list
+	void update(abort_token& aborter, size_t chunk_size = 4096)
+	{
+		if (dirty_list.empty())
+			return;
+		if (dirty_list.size() * 4 >= size())
+		{
+			const auto domain = generate_parallel_for_domain_1d<size_t>(size(), chunk_size);
+			parallel_for(domain, [&](const work_block<size_t>& block)
+			{
+				update_range(block.tile.minx, block.tile.maxx - block.tile.minx);
+			}, aborter);
+		}
+		else
+		{
+			const auto domain = generate_parallel_for_domain_1d<size_t>(dirty_list.size(), chunk_size);
+			parallel_for(domain, [&](const work_block<size_t>& block)
+			{
+				for (auto i = block.tile.minx; i < block.tile.maxx; i++)
+					update_range(dirty_list[i], 1);
+			}, aborter);
+		}
+		if (aborter.aborted)
+			return;
+		for (const auto index : dirty_list)
+			dirty[index] = 0;
+		dirty_list.clear();
+	}
+
+	// union of the world bounds of every instance, call update() first
+	luc::Bounds3 world_bounds(abort_token& aborter, size_t chunk_size = 4096) const
+	{
+		const auto domain = generate_parallel_for_domain_1d<size_t>(size(), chunk_size);
+		return parallel_reduce(domain, luc::Bounds3(), [&](const work_block<size_t>& block, luc::Bounds3& result)
+		{
+			for (size_t axis = 0; axis < 3; axis++)
+			{
+				const auto* min = world_min[axis].data();
+				const auto* max = world_max[axis].data();
+				auto low = result.min.E[axis];
+				auto high = result.max.E[axis];
+				for (auto i = block.tile.minx; i < block.tile.maxx; i++)
+				{
+					low = std::min(low, min[i]);
+					high = std::max(high, max[i]);
+				}
+				result.min.E[axis] = low;
+				result.max.E[axis] = high;
+			}
+		}, [](luc::Bounds3 a, const luc::Bounds3& b)
+		{
+			a.Union(b);
+			return a;
+		}, aborter);
+	}
+
+private:
+	void update_range(size_t begin, size_t count)
+	{
+		for (size_t j = 0; j < 12; j++)
+			lerp_stream(count, time, key0[j].data() + begin, key1[j].data() + begin, world[j].data() + begin);
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			transform_bounds_axis(count, world[axis].data() + begin, world[3 + axis].data() + begin, world[6 + axis].data() + begin, world[9 + axis].data() + begin,
+				local_center[0].data() + begin, local_center[1].data() + begin, local_center[2].data() + begin,
+				local_extent[0].data() + begin, local_extent[1].data() + begin, local_extent[2].data() + begin,
+				world_min[axis].data() + begin, world_max[axis].data() + begin);
+		}
+	}
+};
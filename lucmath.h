@@ -27,10 +27,31 @@
 
 #include <cmath>
 #include <array>
+#include <bit>
+#include <cstdint>
 #include <functional>
 #include <limits>
+#include <tuple>
+#include <type_traits>
 #include "lucmath_gen.h"
 
+// precision of Rsqrt, FastExp, FastLog, SinCos and Normalize, pick one before including
+// EXACT calls libm, ULP stays within a few ulp and FAST within about 1e-4 relative error,
+// the approximations are branchless so loops over them vectorize, double always uses libm
+#define LUCMATH_PRECISION_EXACT 0
+#define LUCMATH_PRECISION_ULP   1
+#define LUCMATH_PRECISION_FAST  2
+#ifndef LUCMATH_PRECISION
+#define LUCMATH_PRECISION LUCMATH_PRECISION_EXACT
+#endif
+
+// the approximations are too long for the default inlining budget, which keeps callers from vectorizing
+#if defined(_MSC_VER)
+#define LUCMATH_INLINE __forceinline
+#else
+#define LUCMATH_INLINE inline __attribute__((always_inline))
+#endif
+
 namespace luc
 {
 
@@ -151,13 +172,211 @@ auto Distance(const VectorTN<T, N>& a, const T& b)
     return result;
 }
 
+template<typename T>
+constexpr bool UseFastMath = std::is_same_v<T, float> && LUCMATH_PRECISION != LUCMATH_PRECISION_EXACT;
+
+// bitwise select, a float ?: is kept as a branch unless -fno-trapping-math and blocks vectorization
+inline float Select(const bool condition, const float a, const float b)
+{
+    const auto mask = 0u - static_cast<uint32_t>(condition);
+    return std::bit_cast<float>((std::bit_cast<uint32_t>(a) & mask) | (std::bit_cast<uint32_t>(b) & ~mask));
+}
+
+// rounds half away from zero, std::floor does not vectorize without -fno-trapping-math either
+inline int32_t RoundToInt(const float x)
+{
+    return static_cast<int32_t>(x + Select(x < 0.f, -0.5f, 0.5f));
+}
+
+template<typename T>
+LUCMATH_INLINE auto Rsqrt(const T x)
+{
+    if constexpr (UseFastMath<T>)
+    {
+        // bit level initial guess, each newton step roughly squares the relative error
+        auto y = std::bit_cast<float>(0x5f375a86u - (std::bit_cast<uint32_t>(x) >> 1));
+        y      = y * (1.5f - 0.5f * x * y * y);
+        y      = y * (1.5f - 0.5f * x * y * y);
+        if constexpr (LUCMATH_PRECISION == LUCMATH_PRECISION_ULP)
+            y = y * (1.5f - 0.5f * x * y * y);
+        return y;
+    }
+    else
+        return static_cast<T>(1) / std::sqrt(x);
+}
+
+template<typename T>
+LUCMATH_INLINE auto FastExp(const T x)
+{
+    if constexpr (UseFastMath<T>)
+    {
+        // exp(x) = 2^n * exp(r) with |r| <= ln(2) / 2
+        const auto clamped = Select(x < -87.3f, -87.3f, Select(x > 88.7f, 88.7f, x));
+        const auto n_int   = RoundToInt(clamped * 1.44269504f);
+        const auto n       = static_cast<float>(n_int);
+        const auto r       = clamped - n * 0.693359375f + n * 2.12194440e-4f;
+        float      p;
+        if constexpr (LUCMATH_PRECISION == LUCMATH_PRECISION_ULP)
+        {
+            p = 1.9875691500e-4f;
+            p = p * r + 1.3981999507e-3f;
+            p = p * r + 8.3334519073e-3f;
+            p = p * r + 4.1665795894e-2f;
+            p = p * r + 1.6666665459e-1f;
+            p = p * r + 5.0000001201e-1f;
+        }
+        else
+            p = 0.5f + r * (1.f / 6.f + r * (1.f / 24.f));
+        // 2^n is applied in two halves so neither factor leaves the normal range
+        const auto half_n = n_int >> 1;
+        const auto scale0 = std::bit_cast<float>(static_cast<uint32_t>(half_n + 127) << 23);
+        const auto scale1 = std::bit_cast<float>(static_cast<uint32_t>(n_int - half_n + 127) << 23);
+        const auto result = (p * r * r + r + 1.f) * scale0 * scale1;
+        const auto limit  = Select(x > 88.7f, std::numeric_limits<float>::infinity(), 0.f);
+        return Select(x != x, x, Select((x < -87.3f) | (x > 88.7f), limit, result));
+    }
+    else
+        return std::exp(x);
+}
+
+template<typename T>
+LUCMATH_INLINE auto FastLog(const T x)
+{
+    if constexpr (UseFastMath<T>)
+    {
+        // log(x) = e * ln(2) + log(m) with m in [sqrt(0.5), sqrt(2))
+        const auto denormal = x < std::numeric_limits<float>::min();
+        const auto bits     = std::bit_cast<uint32_t>(Select(denormal, x * 8388608.f, x));
+        auto       e        = static_cast<float>(static_cast<int32_t>(bits >> 23) - 127 - 23 * static_cast<int32_t>(denormal));
+        auto       m        = std::bit_cast<float>((bits & 0x007fffffu) | 0x3f800000u);
+        const auto high     = m > 1.41421356f;
+        m                   = Select(high, m * 0.5f, m);
+        e                   = Select(high, e + 1.f, e);
+        float log_m;
+        if constexpr (LUCMATH_PRECISION == LUCMATH_PRECISION_ULP)
+        {
+            const auto f = m - 1.f;
+            const auto z = f * f;
+            auto       y = 7.0376836292e-2f;
+            y            = y * f - 1.1514610310e-1f;
+            y            = y * f + 1.1676998740e-1f;
+            y            = y * f - 1.2420140846e-1f;
+            y            = y * f + 1.4249322787e-1f;
+            y            = y * f - 1.6668057665e-1f;
+            y            = y * f + 2.0000714765e-1f;
+            y            = y * f - 2.4999993993e-1f;
+            y            = y * f + 3.3333331174e-1f;
+            y            = y * f * z - e * 2.12194440e-4f - 0.5f * z;
+            log_m        = f + y + e * 0.693359375f;
+        }
+        else
+        {
+            const auto f = (m - 1.f) / (m + 1.f);
+            const auto z = f * f;
+            log_m        = 2.f * f * (1.f + z * (1.f / 3.f + z * (1.f / 5.f))) + e * 0.693147181f;
+        }
+        const auto special = Select((x < 0.f) | (x != x), std::numeric_limits<float>::quiet_NaN(), Select(x == 0.f, -std::numeric_limits<float>::infinity(), x));
+        return Select((x > 0.f) & (x < std::numeric_limits<float>::infinity()), log_m, special);
+    }
+    else
+        return std::log(x);
+}
+
+// returns (sin(x), cos(x)), the fast paths reduce by pi / 2 in three parts and lose accuracy
+// beyond |x| of a few thousand
+template<typename T>
+LUCMATH_INLINE auto SinCos(const T x)
+{
+    if constexpr (UseFastMath<T>)
+    {
+        const auto j_int = RoundToInt(x * 0.636619772f);
+        const auto j     = static_cast<float>(j_int);
+        const auto r = ((x - j * 1.5703125f) - j * 4.83751297e-4f) - j * 7.54978995e-8f;
+        const auto z = r * r;
+        float      s, c;
+        if constexpr (LUCMATH_PRECISION == LUCMATH_PRECISION_ULP)
+        {
+            s = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+            c = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.f;
+        }
+        else
+        {
+            s = (8.3333333e-3f * z - 1.6666667e-1f) * z * r + r;
+            c = ((-1.3888889e-3f * z + 4.1666667e-2f) * z - 0.5f) * z + 1.f;
+        }
+        const auto quadrant = static_cast<uint32_t>(j_int);
+        const auto sin      = std::bit_cast<uint32_t>(Select(quadrant & 1, c, s)) ^ ((quadrant & 2) << 30);
+        const auto cos      = std::bit_cast<uint32_t>(Select(quadrant & 1, s, c)) ^ (((quadrant + 1) & 2) << 30);
+        return std::make_tuple(std::bit_cast<float>(sin), std::bit_cast<float>(cos));
+    }
+    else
+        return std::make_tuple(std::sin(x), std::cos(x));
+}
+
 template<typename T, size_t N>
-auto Normalize(const VectorTN<T, N>& t)
+auto Rsqrt(const VectorTN<T, N>& t)
+{
+    auto result = [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        return VectorTN<T, N>(Rsqrt(std::get<I>(t.E))...);
+    }
+    (std::make_index_sequence<N>{});
+    return result;
+}
+
+template<typename T, size_t N>
+auto FastExp(const VectorTN<T, N>& t)
 {
-    const auto result = t / Length(t);
+    auto result = [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        return VectorTN<T, N>(FastExp(std::get<I>(t.E))...);
+    }
+    (std::make_index_sequence<N>{});
     return result;
 }
 
+template<typename T, size_t N>
+auto FastLog(const VectorTN<T, N>& t)
+{
+    auto result = [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        return VectorTN<T, N>(FastLog(std::get<I>(t.E))...);
+    }
+    (std::make_index_sequence<N>{});
+    return result;
+}
+
+template<typename T, size_t N>
+auto SinCos(const VectorTN<T, N>& t)
+{
+    auto result = [&]<std::size_t... I>(std::index_sequence<I...>)
+    {
+        const std::array<std::tuple<T, T>, N> pairs{ SinCos(std::get<I>(t.E))... };
+        return std::make_tuple(VectorTN<T, N>(std::get<0>(pairs[I])...), VectorTN<T, N>(std::get<1>(pairs[I])...));
+    }
+    (std::make_index_sequence<N>{});
+    return result;
+}
+
+template<typename T, size_t N>
+auto FastNormalize(const VectorTN<T, N>& t)
+{
+    const auto result = t * Rsqrt(LengthSquared(t));
+    return result;
+}
+
+template<typename T, size_t N>
+auto Normalize(const VectorTN<T, N>& t)
+{
+    if constexpr (UseFastMath<T>)
+        return FastNormalize(t);
+    else
+    {
+        const auto result = t / Length(t);
+        return result;
+    }
+}
+
 template<typename T, size_t N>
 auto NormalizedWithLength(const VectorTN<T, N>& a)
 {
@@ -224,6 +443,15 @@ auto Lerp(const T x, const VectorTN<T, N>& a, const VectorTN<T, N>& b)
     return (T(1) - x) * a + x * b;
 }
 
+// blends the columns, exact for translation and scale, a rotation shrinks slightly between
+// keys that are far apart, which is fine for the small steps of a shutter interval
+// columns is used rather than tangent, bi_tangent, normal and offset, which all alias column 0
+template<typename T>
+auto Lerp(const T x, const AffineT<T>& a, const AffineT<T>& b)
+{
+    return AffineT<T>(std::array<VectorTN<T, 3>, 4>{ Lerp(x, a.columns[0], b.columns[0]), Lerp(x, a.columns[1], b.columns[1]), Lerp(x, a.columns[2], b.columns[2]), Lerp(x, a.columns[3], b.columns[3]) });
+}
+
 template<typename T>
 auto Clamp(const T x, const T min, const T max)
 {
@@ -1,18 +1,75 @@
 #pragma once
 #include "lucmath.h"
+#include "arena.h"
 #include <vector>
 #include <thread>
 #include <functional>
 #include <numeric>
 #include <tuple>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <queue>
 #include <optional>
+#include <atomic>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+struct parallel_for_settings
+{
+	size_t thread_count = 0;
+	int max_size = 32;
+	int split_size = 4;
+};
+
+inline parallel_for_settings& parallel_for_defaults()
+{
+	static parallel_for_settings settings;
+	return settings;
+}
+
+inline size_t parallel_for_thread_count()
+{
+	const auto configured = parallel_for_defaults().thread_count;
+	if (configured > 0)
+		return configured;
+	const auto hardware_concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+	//const auto number_of_threads = hardware_concurrency;
+	const auto number_of_threads = hardware_concurrency * 4 / 3;
+	//const auto number_of_threads = hardware_concurrency * 32 / 22;
+	//const auto number_of_threads = hardware_concurrency * 3 / 2;
+	return number_of_threads;
+}
+
+// shared by the workers of one parallel_for, holds the tile queue lock and the subtasks tiles fork,
+// a subtask gets the index of the worker that runs it so it can use that worker's scratch arena
+struct fork_join
+{
+	std::mutex mutex;
+	std::condition_variable signal;
+	std::deque<std::function<void(size_t)>> tasks;
+	std::vector<arena*> scratch;
+	bool run_one(std::unique_lock<std::mutex>& lock, size_t worker)
+	{
+		if (tasks.empty())
+			return false;
+		auto task = std::move(tasks.front());
+		tasks.pop_front();
+		lock.unlock();
+		task(worker);
+		lock.lock();
+		return true;
+	}
+};
 
 template<typename TSize>
 struct work_range
 {
 	TSize minx, maxx, miny, maxy;
+	TSize stride = 1;
+	// when set, the points on this coarser stride grid were rendered by an earlier pass and are skipped
+	TSize coarse_stride = 0;
 	work_range() = default;
 	work_range(TSize min_x, TSize max_x, TSize min_y, TSize max_y) : minx(min_x), maxx(max_x), miny(min_y), maxy(max_y) {}
 };
@@ -22,6 +79,8 @@ struct work_domain
 {
 	work_range<TSize> range;
 	std::vector<work_range<TSize>> ranges;
+	TSize split_size = TSize(parallel_for_defaults().split_size);
+	TSize micro_size = 0;
 	work_domain() = default;
 	work_domain(TSize min_x, TSize max_x, TSize min_y, TSize max_y) : range(min_x, max_x, min_y, max_y) {}
 };
@@ -31,6 +90,10 @@ struct work_block
 {
 	work_range<TSize> tile;
 	work_range<TSize> domain;
+	TSize micro_size = 0;
+	fork_join* pool = nullptr;
+	size_t worker = 0;
+	arena* scratch = nullptr;
 	work_block() = default;
 	work_block(work_range<TSize> _tile, work_range<TSize> _domain) : tile(_tile), domain(_domain) {}
 };
@@ -49,22 +112,26 @@ std::pair<work_range<TSize>, work_range<TSize>> split_range(const work_range<TSi
 		max = range.maxx;
 	}
 	auto mid = std::midpoint(min, max);
+	if (range.stride > 1)
+		mid -= mid % range.stride;
+	work_range<TSize> a, b;
 	if (vertical)
 	{
-		work_range<TSize> a(range.minx, mid, range.miny, range.maxy);
-		work_range<TSize> b(mid, max, range.miny, range.maxy);
-		return std::make_pair(a, b);
+		a = work_range<TSize>(range.minx, mid, range.miny, range.maxy);
+		b = work_range<TSize>(mid, max, range.miny, range.maxy);
 	}
 	else
 	{
-		work_range<TSize> a(range.minx, range.maxx, range.miny, mid);
-		work_range<TSize> b(range.minx, range.maxx, mid, range.maxy);
-		return std::make_pair(a, b);
+		a = work_range<TSize>(range.minx, range.maxx, range.miny, mid);
+		b = work_range<TSize>(range.minx, range.maxx, mid, range.maxy);
 	}
+	a.stride = b.stride = range.stride;
+	a.coarse_stride = b.coarse_stride = range.coarse_stride;
+	return std::make_pair(a, b);
 }
 
 template<typename TSize>
-work_domain<TSize> generate_parallel_for_domain(TSize min_x, TSize max_x, TSize min_y, TSize max_y)
+work_domain<TSize> generate_parallel_for_domain(TSize min_x, TSize max_x, TSize min_y, TSize max_y, TSize max_size = TSize(parallel_for_defaults().max_size))
 {
 	work_domain<TSize> domain(min_x, max_x, min_y, max_y);
 	std::queue<work_range<TSize>> queue;
@@ -73,7 +140,6 @@ work_domain<TSize> generate_parallel_for_domain(TSize min_x, TSize max_x, TSize
 	{
 		const auto range = queue.front();
 		queue.pop();
-		const TSize max_size = 32;
 		const auto w = range.maxx - range.minx;
 		const auto h = range.maxy - range.miny;
 		if (std::max(w, h) > max_size)
@@ -96,6 +162,76 @@ work_domain<TSize> generate_parallel_for_domain(TSize width, TSize height)
 	return generate_parallel_for_domain(0, width, 0, height);
 }
 
+inline size_t l1_cache_size()
+{
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_SIZE)
+	const auto size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+	if (size > 0)
+		return size_t(size);
+#endif
+	return size_t(32) << 10;
+}
+
+inline size_t l2_cache_size()
+{
+#if defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+	const auto size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (size > 0)
+		return size_t(size);
+#endif
+	return size_t(1) << 20;
+}
+
+// macro tiles are what parallel_for schedules and steals, micro tiles are what iterate_over_tile
+// walks inside them
+template<typename TSize>
+work_domain<TSize> generate_hierarchical_domain(TSize width, TSize height, TSize macro_size, TSize micro_size)
+{
+	auto domain = generate_parallel_for_domain(TSize(0), width, TSize(0), height, macro_size);
+	domain.micro_size = micro_size;
+	return domain;
+}
+
+// sizes both levels from the measured caches given the bytes a tile function touches per pixel,
+// micro tiles fill half of l1 and macro tiles half of l2
+template<typename TSize>
+work_domain<TSize> generate_hierarchical_domain(TSize width, TSize height, size_t bytes_per_pixel = 64)
+{
+	const auto fit = [bytes_per_pixel](size_t budget)
+	{
+		TSize size = 4;
+		while (size_t(size) * size_t(size) * 4 * bytes_per_pixel <= budget)
+			size *= 2;
+		return size;
+	};
+	return generate_hierarchical_domain(width, height, fit(l2_cache_size() / 2), fit(l1_cache_size() / 2));
+}
+
+template<typename TSize>
+work_domain<TSize> generate_tiled_domain(TSize width, TSize height, TSize tile_size)
+{
+	work_domain<TSize> domain(0, width, 0, height);
+	for (TSize y = 0; y < height; y += tile_size)
+	{
+		for (TSize x = 0; x < width; x += tile_size)
+		{
+			domain.ranges.emplace_back(x, std::min(x + tile_size, width), y, std::min(y + tile_size, height));
+		}
+	}
+	return domain;
+}
+
+template<typename TSize>
+work_domain<TSize> generate_parallel_for_domain_1d(TSize count, TSize chunk_size)
+{
+	work_domain<TSize> domain(0, count, 0, 1);
+	for (TSize begin = 0; begin < count; begin += chunk_size)
+	{
+		domain.ranges.emplace_back(begin, std::min(begin + chunk_size, count), 0, 1);
+	}
+	return domain;
+}
+
 template<typename TSize>
 std::queue<work_range<TSize>> range_queue_from_domain(const std::vector<work_range<TSize>>& domain_ranges)
 {
@@ -108,16 +244,21 @@ std::queue<work_range<TSize>> range_queue_from_domain(const std::vector<work_ran
 }
 
 template<typename TSize, typename TFloat=float>
-void iterate_over_tile(const work_block<TSize>& block, auto&& item_func)
+void iterate_over_range(const work_range<TSize>& tile, const work_range<TSize>& domain, auto&& item_func)
 {
-	for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+	const auto stride = tile.stride;
+	const auto coarse = tile.coarse_stride;
+	for (auto y = tile.miny; y < tile.maxy; y += stride)
 	{
-		for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+		const auto coarse_row = coarse > 0 && y % coarse == 0;
+		for (auto x = tile.minx; x < tile.maxx; x += stride)
 		{
-			const auto minx = luc::Map<TFloat>(x, block.domain.minx, block.domain.maxx, 0, 1) - TFloat(.5);
-			const auto miny = luc::Map<TFloat>(y, block.domain.miny, block.domain.maxy, 0, 1) - TFloat(.5);
-			const auto maxx = luc::Map<TFloat>(x + TFloat(1.), block.domain.minx, block.domain.maxx, 0, 1) - TFloat(.5);
-			const auto maxy = luc::Map<TFloat>(y + TFloat(1.), block.domain.miny, block.domain.maxy, 0, 1) - TFloat(.5);
+			if (coarse_row && x % coarse == 0)
+				continue;
+			const auto minx = luc::Map<TFloat>(x, domain.minx, domain.maxx, 0, 1) - TFloat(.5);
+			const auto miny = luc::Map<TFloat>(y, domain.miny, domain.maxy, 0, 1) - TFloat(.5);
+			const auto maxx = luc::Map<TFloat>(std::min(x + stride, tile.maxx), domain.minx, domain.maxx, 0, 1) - TFloat(.5);
+			const auto maxy = luc::Map<TFloat>(std::min(y + stride, tile.maxy), domain.miny, domain.maxy, 0, 1) - TFloat(.5);
 			auto transform = [minx, miny, maxx, maxy](TFloat u, TFloat v)
 			{
 				const auto su = luc::Map<TFloat>(u, -.5f, .5f, minx, maxx);
@@ -129,54 +270,185 @@ void iterate_over_tile(const work_block<TSize>& block, auto&& item_func)
 	}
 }
 
+// walks the tile one micro tile at a time when the domain asks for it, keeping the working set
+// of neighbouring pixels inside l1 while the macro tile stays the unit of scheduling
+template<typename TSize, typename TFloat=float>
+void iterate_over_tile(const work_block<TSize>& block, auto&& item_func)
+{
+	const auto& tile = block.tile;
+	if (block.micro_size <= 0)
+	{
+		iterate_over_range<TSize, TFloat>(tile, block.domain, item_func);
+		return;
+	}
+	const auto micro_size = (block.micro_size + tile.stride - 1) / tile.stride * tile.stride;
+	for (auto my = tile.miny; my < tile.maxy; my += micro_size)
+	{
+		for (auto mx = tile.minx; mx < tile.maxx; mx += micro_size)
+		{
+			work_range<TSize> micro(mx, std::min(mx + micro_size, tile.maxx), my, std::min(my + micro_size, tile.maxy));
+			micro.stride = tile.stride;
+			micro.coarse_stride = tile.coarse_stride;
+			iterate_over_range<TSize, TFloat>(micro, block.domain, item_func);
+		}
+	}
+}
+
+// micro tiles with compile time extents so the inner loops unroll and vectorize, the per pixel
+// mapping is a multiply-add against hoisted reciprocals, edges fall back to iterate_over_tile
+template<int TileWidth, int TileHeight, typename TSize, typename TFloat = float>
+void iterate_over_fixed_tile(const work_block<TSize>& block, auto&& item_func)
+{
+	const auto& tile = block.tile;
+	if (tile.stride != 1 || tile.coarse_stride > 0)
+	{
+		iterate_over_tile<TSize, TFloat>(block, item_func);
+		return;
+	}
+	const auto scale_x = TFloat(1) / TFloat(block.domain.maxx - block.domain.minx);
+	const auto scale_y = TFloat(1) / TFloat(block.domain.maxy - block.domain.miny);
+	const auto offset_x = -TFloat(block.domain.minx) * scale_x - TFloat(.5);
+	const auto offset_y = -TFloat(block.domain.miny) * scale_y - TFloat(.5);
+	const auto end_x = tile.minx + (tile.maxx - tile.minx) / TileWidth * TileWidth;
+	const auto end_y = tile.miny + (tile.maxy - tile.miny) / TileHeight * TileHeight;
+	for (auto my = tile.miny; my < end_y; my += TileHeight)
+	{
+		for (auto mx = tile.minx; mx < end_x; mx += TileWidth)
+		{
+			for (int j = 0; j < TileHeight; j++)
+			{
+				const auto y = my + TSize(j);
+				const auto miny = TFloat(y) * scale_y + offset_y;
+				for (int i = 0; i < TileWidth; i++)
+				{
+					const auto x = mx + TSize(i);
+					const auto minx = TFloat(x) * scale_x + offset_x;
+					auto transform = [minx, miny, scale_x, scale_y](TFloat u, TFloat v)
+					{
+						return luc::VectorTN<TFloat, 2>(minx + (u + TFloat(.5)) * scale_x, miny + (v + TFloat(.5)) * scale_y);
+					};
+					item_func(x, y, transform);
+				}
+			}
+		}
+	}
+	if (end_x < tile.maxx)
+		iterate_over_tile<TSize, TFloat>(work_block<TSize>(work_range<TSize>(end_x, tile.maxx, tile.miny, end_y), block.domain), item_func);
+	if (end_y < tile.maxy)
+		iterate_over_tile<TSize, TFloat>(work_block<TSize>(work_range<TSize>(tile.minx, tile.maxx, end_y, tile.maxy), block.domain), item_func);
+}
+
 struct abort_token
 {
-	bool aborted = false;
+	std::atomic<bool> aborted = false;
 	abort_token() = default;
 	void abort() { aborted = true; }
 };
 
+// splits [0, count) into grain sized chunks that idle workers of the surrounding parallel_for
+// can pick up, the calling tile works through the chunks too and returns once all are done,
+// chunk_func(block, begin, end) gets block with worker and scratch rebound to the worker running
+// the chunk, allocate from that block and not the forking one, whose arena belongs to one thread
+template<typename TSize>
+void fork_join_for(const work_block<TSize>& block, size_t count, size_t grain, auto&& chunk_func)
+{
+	auto* pool = block.pool;
+	grain = std::max<size_t>(grain, 1);
+	if (!pool || count <= grain)
+	{
+		chunk_func(block, size_t(0), count);
+		return;
+	}
+	size_t pending = (count + grain - 1) / grain;
+	{
+		std::scoped_lock lock(pool->mutex);
+		for (size_t begin = grain; begin < count; begin += grain)
+		{
+			pool->tasks.emplace_back([&, begin](size_t worker)
+			{
+				auto chunk_block = block;
+				chunk_block.worker = worker;
+				chunk_block.scratch = worker < pool->scratch.size() ? pool->scratch[worker] : nullptr;
+				// the chunk may run in the middle of another tile on this worker, so only its own
+				// allocations are rewound
+				const auto mark = chunk_block.scratch ? chunk_block.scratch->mark() : arena::position{};
+				chunk_func(chunk_block, begin, std::min(begin + grain, count));
+				if (chunk_block.scratch)
+					chunk_block.scratch->rewind(mark);
+				std::scoped_lock done(pool->mutex);
+				if (--pending == 0)
+					pool->signal.notify_all();
+			});
+		}
+	}
+	pool->signal.notify_all();
+	chunk_func(block, size_t(0), grain);
+	std::unique_lock lock(pool->mutex);
+	pending--;
+	while (pending > 0)
+	{
+		if (!pool->run_one(lock, block.worker))
+			pool->signal.wait(lock);
+	}
+}
+
 template<typename TSize = int, bool parallel = true>
 void parallel_for(const work_domain<TSize>& domain, auto&& tile_func, abort_token& aborter)
 {
 	auto range_queue = range_queue_from_domain(domain.ranges);
-	std::mutex work_stealing_mutex;
-	const auto hardware_concurrency = std::thread::hardware_concurrency();
-	//const auto number_of_threads = hardware_concurrency;
-	const auto number_of_threads = hardware_concurrency * 4 / 3;
-	//const auto number_of_threads = hardware_concurrency * 32 / 22;
-	//const auto number_of_threads = hardware_concurrency * 3 / 2;
-	const auto thread_count = parallel ? number_of_threads : 1;
-	auto worker = [&]()
+	fork_join pool;
+	size_t active_tiles = 0;
+	const auto thread_count = parallel ? parallel_for_thread_count() : 1;
+	auto arenas = arena_pool::global().acquire(thread_count);
+	for (const auto& scratch : arenas)
+		pool.scratch.push_back(scratch.get());
+	auto worker = [&](size_t index)
 	{
 		work_block<TSize> block(domain.range, domain.range);
+		block.micro_size = domain.micro_size;
+		block.pool = &pool;
+		block.worker = index;
+		block.scratch = arenas[index].get();
+		std::unique_lock stealing_work(pool.mutex);
 		while (!aborter.aborted)
 		{
+			if (range_queue.size() == 0)
 			{
-				std::scoped_lock stealing_work(work_stealing_mutex);
-				if (range_queue.size() == 0)
+				// workers stay around while tiles are in flight so they can help with forked subtasks
+				if (pool.run_one(stealing_work, index))
+					continue;
+				if (active_tiles == 0)
 					break;
-				block.tile = range_queue.front();
-				range_queue.pop();
-				const auto w = block.tile.maxx - block.tile.minx;
-				const auto h = block.tile.maxy - block.tile.miny;
-				if (range_queue.size() < thread_count && std::min(w, h) > 4)
-				{
-					const auto& split = split_range(block.tile);
-					range_queue.push(split.second);
-					block.tile = split.first;
-				}
+				pool.signal.wait(stealing_work);
+				continue;
+			}
+			block.tile = range_queue.front();
+			range_queue.pop();
+			const auto w = block.tile.maxx - block.tile.minx;
+			const auto h = block.tile.maxy - block.tile.miny;
+			if (range_queue.size() < thread_count && std::min(w, h) / block.tile.stride > domain.split_size)
+			{
+				const auto& split = split_range(block.tile);
+				range_queue.push(split.second);
+				block.tile = split.first;
 			}
+			active_tiles++;
+			stealing_work.unlock();
 			tile_func(block);
+			block.scratch->reset();
+			stealing_work.lock();
+			if (--active_tiles == 0)
+				pool.signal.notify_all();
 		}
 	};
 	std::vector<std::thread> threads;
 	for (size_t i = 0; i < thread_count; i++)
 	{
-		threads.emplace_back(worker);
+		threads.emplace_back(worker, i);
 	}
 	for (auto& thread : threads)
 	{
 		thread.join();
 	}
+	arena_pool::global().release(std::move(arenas));
 }
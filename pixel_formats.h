@@ -0,0 +1,178 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include "half.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// compact pixel types for framebuffer<TColor>, they store colors but are not meant to be summed
+// into, accumulate in float and convert once per pass with convert_pixels or convert_framebuffer
+
+// 8 bytes per pixel, four half floats
+struct half4
+{
+	uint16_t E[4] = {};
+	half4() = default;
+	explicit half4(const luc::Vector4& color)
+	{
+		for (size_t i = 0; i < 4; i++)
+		{
+			E[i] = float_to_half(color.E[i]);
+		}
+	}
+	explicit operator luc::Vector4() const
+	{
+		return luc::Vector4(half_to_float(E[0]), half_to_float(E[1]), half_to_float(E[2]), half_to_float(E[3]));
+	}
+};
+
+// 4 bytes per pixel, 8 bit mantissas sharing one exponent, positive colors only, the exponent
+// comes straight from the float bits and all cases go through selects so conversion loops vectorize
+struct rgbe
+{
+	uint8_t r = 0, g = 0, b = 0, e = 0;
+	rgbe() = default;
+	explicit rgbe(const luc::Vector3& color)
+	{
+		auto largest = luc::Select(color.r < color.g, color.g, color.r);
+		largest = luc::Select(largest < color.b, color.b, largest);
+		const auto valid = largest > 1e-32f;
+		// frexp's exponent is the biased exponent - 126, scaling by 2^(8 - exponent) is exact
+		const auto biased = std::bit_cast<uint32_t>(largest) >> 23;
+		const auto scale = std::bit_cast<float>((261u - biased) << 23);
+		auto mantissa = [scale](float value)
+		{
+			const auto scaled = value * scale;
+			return uint32_t(luc::Select(scaled < 255.f, luc::Select(scaled > 0.f, scaled, 0.f), 255.f));
+		};
+		r = uint8_t(select_bits(valid, mantissa(color.r), 0u));
+		g = uint8_t(select_bits(valid, mantissa(color.g), 0u));
+		b = uint8_t(select_bits(valid, mantissa(color.b), 0u));
+		e = uint8_t(select_bits(valid, std::min(biased + 2u, 255u), 0u));
+	}
+	// 2^(e - 136) as two factors so neither leaves the normal range, rounds once like ldexp
+	float channel(uint8_t mantissa) const
+	{
+		const auto low = uint32_t(e) >> 1;
+		const auto high = uint32_t(e) - low;
+		const auto value = (float(mantissa) + 0.5f) * std::bit_cast<float>((low + 127u - 68u) << 23) * std::bit_cast<float>((high + 127u - 68u) << 23);
+		return luc::Select(e == 0, 0.f, value);
+	}
+	explicit operator luc::Vector3() const
+	{
+		return luc::Vector3(channel(r), channel(g), channel(b));
+	}
+};
+
+// 4 bytes per pixel, unsigned 11 bit floats for red and green and a 10 bit float for blue, all
+// with 5 exponent bits like half, negatives and nans are stored as 0
+struct r11g11b10
+{
+	uint32_t bits = 0;
+	r11g11b10() = default;
+	explicit r11g11b10(const luc::Vector3& color)
+	{
+		bits = pack(color.r, 4) | (pack(color.g, 4) << 11) | (pack(color.b, 5) << 22);
+	}
+	// rounds the half float bits to nearest even, dropping the low mantissa bits
+	static uint32_t pack(float value, int dropped)
+	{
+		const uint32_t half = float_to_half(value);
+		const auto infinity = 0x7c00u >> dropped;
+		const auto rounded = (half + (1u << (dropped - 1)) - 1u + ((half >> dropped) & 1u)) >> dropped;
+		return select_bits(value > 0.f, std::min(rounded, infinity), 0u);
+	}
+	static float unpack(uint32_t value, int dropped)
+	{
+		return half_to_float(uint16_t(value << dropped));
+	}
+	float channel(size_t i) const
+	{
+		return i == 0 ? unpack(bits & 0x7ffu, 4) : i == 1 ? unpack((bits >> 11) & 0x7ffu, 4) : unpack(bits >> 22, 5);
+	}
+	explicit operator luc::Vector3() const
+	{
+		return luc::Vector3(channel(0), channel(1), channel(2));
+	}
+};
+
+template<>
+struct pixel_traits<half4>
+{
+	static constexpr size_t channels = 4;
+	static float channel(const half4& color, size_t i) { return half_to_float(color.E[i]); }
+};
+
+template<>
+struct pixel_traits<rgbe>
+{
+	static constexpr size_t channels = 3;
+	static float channel(const rgbe& color, size_t i) { return color.channel(i == 0 ? color.r : i == 1 ? color.g : color.b); }
+};
+
+template<>
+struct pixel_traits<r11g11b10>
+{
+	static constexpr size_t channels = 3;
+	static float channel(const r11g11b10& color, size_t i) { return color.channel(i); }
+};
+
+// converts count pixels through the explicit constructors above, all of which are branch free so
+// this loop vectorizes for every format, half4 uses f16c when available
+template<typename TSource, typename TTarget>
+void convert_pixels(const TSource* source, TTarget* target, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		target[i] = TTarget(source[i]);
+	}
+}
+
+#if defined(__F16C__)
+template<>
+inline void convert_pixels(const luc::Vector4* source, half4* target, size_t count)
+{
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		const auto floats = _mm256_loadu_ps(&source[i].E[0]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(target[i].E), _mm256_cvtps_ph(floats, _MM_FROUND_TO_NEAREST_INT));
+	}
+	for (; i < count; i++)
+	{
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(target[i].E), _mm_cvtps_ph(_mm_loadu_ps(&source[i].E[0]), _MM_FROUND_TO_NEAREST_INT));
+	}
+}
+
+template<>
+inline void convert_pixels(const half4* source, luc::Vector4* target, size_t count)
+{
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		const auto halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source[i].E));
+		_mm256_storeu_ps(&target[i].E[0], _mm256_cvtph_ps(halves));
+	}
+	for (; i < count; i++)
+	{
+		_mm_storeu_ps(&target[i].E[0], _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source[i].E))));
+	}
+}
+#endif
+
+// converts a whole framebuffer in parallel chunks, target is resized to match source
+template<typename TSource, typename TTarget>
+void convert_framebuffer(const framebuffer<TSource>& source, framebuffer<TTarget>& target, abort_token& aborter, size_t chunk_size = 4096)
+{
+	if (target.width != source.width || target.height != source.height || target.pixels.size() != source.pixels.size())
+		target = framebuffer<TTarget>(source.width, source.height);
+	const auto domain = generate_parallel_for_domain_1d<size_t>(source.pixels.size(), chunk_size);
+	parallel_for(domain, [&](const work_block<size_t>& block)
+	{
+		convert_pixels(source.pixels.data() + block.tile.minx, target.pixels.data() + block.tile.minx, block.tile.maxx - block.tile.minx);
+	}, aborter);
+}
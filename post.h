@@ -0,0 +1,147 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include <type_traits>
+
+// reads clamp to the region the previous stage produced, which at image borders is clamp-to-edge
+template<typename TColor>
+struct post_input
+{
+	const framebuffer_tile<TColor>& tile;
+	const TColor& operator()(int x, int y) const
+	{
+		x = luc::Clamp(x, tile.minx, tile.minx + tile.width - 1);
+		y = luc::Clamp(y, tile.miny, tile.miny + tile.height - 1);
+		return tile.pixel(x, y);
+	}
+};
+
+template<typename TFunc>
+struct post_stage
+{
+	int halo;
+	TFunc func;
+};
+
+auto post_filter(int halo, auto&& func)
+{
+	return post_stage<std::decay_t<decltype(func)>>{ halo, func };
+}
+
+auto post_pixel(auto&& func)
+{
+	return post_filter(0, [func](const auto& in, int x, int y)
+	{
+		return func(in(x, y));
+	});
+}
+
+inline auto post_tonemap_reinhard(float exposure = 1.f)
+{
+	return post_pixel([exposure](const auto& color)
+	{
+		using TColor = std::decay_t<decltype(color)>;
+		const auto exposed = color * exposure;
+		return TColor(exposed / (TColor(1.f) + exposed));
+	});
+}
+
+inline auto post_box_blur(int radius)
+{
+	return post_filter(radius, [radius](const auto& in, int x, int y)
+	{
+		using TColor = std::decay_t<decltype(in(x, y))>;
+		TColor sum(0.f);
+		for (int dy = -radius; dy <= radius; dy++)
+		{
+			for (int dx = -radius; dx <= radius; dx++)
+			{
+				sum = sum + in(x + dx, y + dy);
+			}
+		}
+		const auto count = float((2 * radius + 1) * (2 * radius + 1));
+		return TColor(sum * (1.f / count));
+	});
+}
+
+// runs every stage over one tile (plus the aprons the later stages need) before moving on to the
+// next tile, target may be a 1/n downsample of source in which case the tile is box filtered last,
+// returns false without touching target when it is neither the same size nor an exact 1/n of source
+template<typename TColor>
+bool post_process(const framebuffer<TColor>& source, framebuffer<TColor>& target, abort_token& aborter, const auto&... stages)
+{
+	if (target.width <= 0 || target.height <= 0)
+		return false;
+	const auto factor = std::max(1, source.width / target.width);
+	if (source.width != target.width * factor || source.height != target.height * factor)
+		return false;
+	const auto total_halo = (0 + ... + stages.halo);
+	const auto domain = generate_parallel_for_domain(target.width, target.height);
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		thread_local framebuffer_tile<TColor> buffers[2];
+		auto* input = &buffers[0];
+		auto* output = &buffers[1];
+		const work_range<int> region(block.tile.minx * factor, std::min(block.tile.maxx * factor, source.width), block.tile.miny * factor, std::min(block.tile.maxy * factor, source.height));
+		auto load = [&](framebuffer_tile<TColor>& tile, int halo)
+		{
+			const auto minx = std::max(region.minx - halo, 0);
+			const auto miny = std::max(region.miny - halo, 0);
+			const auto maxx = std::min(region.maxx + halo, source.width);
+			const auto maxy = std::min(region.maxy + halo, source.height);
+			tile.reset(minx, miny, maxx - minx, maxy - miny);
+		};
+		load(*input, total_halo);
+		for (auto y = input->miny; y < input->miny + input->height; y++)
+		{
+			for (auto x = input->minx; x < input->minx + input->width; x++)
+			{
+				input->pixel(x, y) = source.pixels[x + y * source.width];
+			}
+		}
+		// a pure downsample has no stages to run
+		if constexpr (sizeof...(stages) > 0)
+		{
+			auto remaining = total_halo;
+			auto run = [&](const auto& stage)
+			{
+				remaining -= stage.halo;
+				load(*output, remaining);
+				const post_input<TColor> in{ *input };
+				for (auto y = output->miny; y < output->miny + output->height; y++)
+				{
+					for (auto x = output->minx; x < output->minx + output->width; x++)
+					{
+						output->pixel(x, y) = stage.func(in, x, y);
+					}
+				}
+				std::swap(input, output);
+			};
+			(run(stages), ...);
+		}
+		const auto weight = 1.f / float(factor * factor);
+		for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+		{
+			for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+			{
+				if (factor == 1)
+				{
+					target.pixel(x, y) = input->pixel(x, y);
+					continue;
+				}
+				TColor sum(0.f);
+				for (int sy = 0; sy < factor; sy++)
+				{
+					for (int sx = 0; sx < factor; sx++)
+					{
+						const auto px = std::min(x * factor + sx, source.width - 1);
+						const auto py = std::min(y * factor + sy, source.height - 1);
+						sum = sum + input->pixel(px, py);
+					}
+				}
+				target.pixel(x, y) = TColor(sum * weight);
+			}
+		}
+	}, aborter);
+	return true;
+}
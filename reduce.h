@@ -0,0 +1,90 @@
+#pragma once
+#include "parallel_for.h"
+#include <limits>
+
+template<typename T>
+struct alignas(64) padded_partial
+{
+	T value;
+};
+
+template<typename T>
+T combine_tree(std::vector<padded_partial<T>>& partials, auto&& combine)
+{
+	for (size_t step = 1; step < partials.size(); step *= 2)
+	{
+		for (size_t i = 0; i + step < partials.size(); i += 2 * step)
+		{
+			partials[i].value = combine(partials[i].value, partials[i + step].value);
+		}
+	}
+	return partials.front().value;
+}
+
+// runs tile_func(block, index) for every range of domain with index as its position in
+// domain.ranges, ranges are never split so every index is visited exactly once
+template<typename TSize>
+void parallel_for_indexed(const work_domain<TSize>& domain, auto&& tile_func, abort_token& aborter)
+{
+	auto indices = generate_parallel_for_domain_1d<TSize>(TSize(domain.ranges.size()), 1);
+	indices.split_size = std::numeric_limits<TSize>::max();
+	parallel_for(indices, [&](const work_block<TSize>& index_block)
+	{
+		auto block = index_block;
+		block.domain = domain.range;
+		block.micro_size = domain.micro_size;
+		for (auto i = index_block.tile.minx; i < index_block.tile.maxx; i++)
+		{
+			block.tile = domain.ranges[i];
+			tile_func(block, size_t(i));
+		}
+	}, aborter);
+}
+
+// tile_func(block, accumulator) folds a tile into a per worker partial, partials are cache line
+// padded and combined pairwise, deterministic keeps one partial per range so the combine order
+// does not depend on scheduling
+template<typename TSize, typename T>
+T parallel_reduce(const work_domain<TSize>& domain, const T& identity, auto&& tile_func, auto&& combine, abort_token& aborter, bool deterministic = false)
+{
+	if (deterministic)
+	{
+		std::vector<padded_partial<T>> partials(std::max<size_t>(domain.ranges.size(), 1), { identity });
+		parallel_for_indexed(domain, [&](const work_block<TSize>& block, size_t index)
+		{
+			tile_func(block, partials[index].value);
+		}, aborter);
+		return combine_tree(partials, combine);
+	}
+	std::vector<padded_partial<T>> partials(parallel_for_thread_count(), { identity });
+	parallel_for(domain, [&](const work_block<TSize>& block)
+	{
+		tile_func(block, partials[block.worker].value);
+	}, aborter);
+	return combine_tree(partials, combine);
+}
+
+// two passes in domain.ranges order, reduce_func(block, sum) totals each range and
+// scan_func(block, offset) then sees the combined total of every range before it,
+// returns the total of the whole domain
+template<typename TSize, typename T>
+T parallel_scan(const work_domain<TSize>& domain, const T& identity, auto&& reduce_func, auto&& scan_func, auto&& combine, abort_token& aborter)
+{
+	std::vector<padded_partial<T>> sums(domain.ranges.size(), { identity });
+	parallel_for_indexed(domain, [&](const work_block<TSize>& block, size_t index)
+	{
+		reduce_func(block, sums[index].value);
+	}, aborter);
+	auto total = identity;
+	for (auto& sum : sums)
+	{
+		const auto range_total = sum.value;
+		sum.value = total;
+		total = combine(total, range_total);
+	}
+	parallel_for_indexed(domain, [&](const work_block<TSize>& block, size_t index)
+	{
+		scan_func(block, sums[index].value);
+	}, aborter);
+	return total;
+}
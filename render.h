@@ -1,10 +1,115 @@
 #pragma once
 #include "parallel_for.h"
 #include "framebuffer.h"
+#include <cstdint>
+#include <limits>
 
 template<typename TColor>
-void render(framebuffer<TColor> framebuffer, auto&& tile_func, abort_token& aborter)
+void render(const framebuffer<TColor>& framebuffer, auto&& tile_func, abort_token& aborter)
 {
     const auto domain = generate_parallel_for_domain(framebuffer.width, framebuffer.height);
     parallel_for(domain, tile_func, aborter);
+}
+
+// one range per dirty grid cell, shrunk to the bounds of the dirty area inside it, so overlapping
+// regions never hand the same pixel to two tiles
+template<typename TSize>
+struct dirty_cells
+{
+	TSize cell_size, cells_x, cells_y;
+	work_domain<TSize> domain;
+	std::vector<work_range<TSize>> bounds;
+	dirty_cells(TSize width, TSize height, TSize _cell_size = TSize(parallel_for_defaults().max_size)) : cell_size(_cell_size), domain(0, width, 0, height)
+	{
+		cells_x = (width + cell_size - 1) / cell_size;
+		cells_y = (height + cell_size - 1) / cell_size;
+		bounds.resize(size_t(cells_x) * size_t(cells_y), work_range<TSize>(width, 0, height, 0));
+	}
+	void mark(const work_range<TSize>& region)
+	{
+		const auto minx = std::max(region.minx, domain.range.minx), maxx = std::min(region.maxx, domain.range.maxx);
+		const auto miny = std::max(region.miny, domain.range.miny), maxy = std::min(region.maxy, domain.range.maxy);
+		if (minx >= maxx || miny >= maxy)
+			return;
+		for (auto cy = miny / cell_size; cy <= (maxy - 1) / cell_size; cy++)
+		{
+			for (auto cx = minx / cell_size; cx <= (maxx - 1) / cell_size; cx++)
+			{
+				auto& cell = bounds[cx + cy * cells_x];
+				cell.minx = std::min(cell.minx, std::max(minx, cx * cell_size));
+				cell.maxx = std::max(cell.maxx, std::min(maxx, (cx + 1) * cell_size));
+				cell.miny = std::min(cell.miny, std::max(miny, cy * cell_size));
+				cell.maxy = std::max(cell.maxy, std::min(maxy, (cy + 1) * cell_size));
+			}
+		}
+	}
+	work_domain<TSize> build() const
+	{
+		auto result = domain;
+		for (const auto& cell : bounds)
+		{
+			if (cell.minx < cell.maxx && cell.miny < cell.maxy)
+				result.ranges.push_back(cell);
+		}
+		return result;
+	}
+};
+
+template<typename TSize>
+work_domain<TSize> generate_parallel_for_domain(TSize width, TSize height, const std::vector<work_range<TSize>>& regions)
+{
+	dirty_cells<TSize> cells(width, height);
+	for (const auto& region : regions)
+	{
+		cells.mark(region);
+	}
+	return cells.build();
+}
+
+// only the part of the mask inside width x height is scanned, a mask that does not match the
+// framebuffer never yields tiles outside it
+inline work_domain<int> generate_parallel_for_domain(const framebuffer<uint8_t>& dirty_mask, int width, int height)
+{
+	width = std::min(width, dirty_mask.width);
+	height = std::min(height, dirty_mask.height);
+	dirty_cells<int> cells(width, height);
+	auto scan = generate_tiled_domain(width, height, cells.cell_size);
+	scan.split_size = std::numeric_limits<int>::max();
+	abort_token aborter;
+	parallel_for(scan, [&](const work_block<int>& block)
+	{
+		auto& cell = cells.bounds[block.tile.minx / cells.cell_size + (block.tile.miny / cells.cell_size) * cells.cells_x];
+		for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+		{
+			for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+			{
+				if (dirty_mask.pixels[x + y * dirty_mask.width] == 0)
+					continue;
+				cell.minx = std::min(cell.minx, x);
+				cell.maxx = std::max(cell.maxx, x + 1);
+				cell.miny = std::min(cell.miny, y);
+				cell.maxy = std::max(cell.maxy, y + 1);
+			}
+		}
+	}, aborter);
+	return cells.build();
+}
+
+inline work_domain<int> generate_parallel_for_domain(const framebuffer<uint8_t>& dirty_mask)
+{
+	return generate_parallel_for_domain(dirty_mask, dirty_mask.width, dirty_mask.height);
+}
+
+template<typename TColor>
+void render(const framebuffer<TColor>& framebuffer, const std::vector<work_range<int>>& regions, auto&& tile_func, abort_token& aborter)
+{
+	const auto domain = generate_parallel_for_domain(framebuffer.width, framebuffer.height, regions);
+	parallel_for(domain, tile_func, aborter);
+}
+
+template<typename TColor>
+void render(const framebuffer<TColor>& framebuffer, const ::framebuffer<uint8_t>& dirty_mask, auto&& tile_func, abort_token& aborter)
+{
+	const auto domain = generate_parallel_for_domain(dirty_mask, framebuffer.width, framebuffer.height);
+	parallel_for(domain, tile_func, aborter);
 }
\ No newline at end of file
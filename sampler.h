@@ -0,0 +1,300 @@
+#pragma once
+#include "parallel_for.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+inline uint32_t hash_u32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t value)
+{
+	return hash_u32(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline uint32_t reverse_bits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// hash based owen scramble, every bit is flipped depending on the bits above it
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed)
+{
+	x = reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverse_bits(x);
+}
+
+// direction numbers of the first two sobol dimensions, the first is the van der corput sequence
+constexpr std::array<std::array<uint32_t, 32>, 2> sobol_directions = []()
+{
+	std::array<std::array<uint32_t, 32>, 2> directions{};
+	for (int k = 0; k < 32; k++)
+	{
+		directions[0][k] = 1u << (31 - k);
+		directions[1][k] = k == 0 ? 1u << 31 : directions[1][k - 1] ^ (directions[1][k - 1] >> 1);
+	}
+	return directions;
+}();
+
+inline uint32_t sobol(uint32_t index, int dimension)
+{
+	uint32_t result = 0;
+	for (int k = 0; index; index >>= 1, k++)
+	{
+		if (index & 1)
+			result ^= sobol_directions[dimension][k];
+	}
+	return result;
+}
+
+inline float sample_to_float(uint32_t bits)
+{
+	return float(bits >> 8) * 0x1p-24f;
+}
+
+// shuffled and owen scrambled 2d sobol, a (0,2)-sequence, so every power of two prefix is
+// stratified in every elementary interval like pmj02
+inline luc::Vector2 owen_sobol_2d(uint32_t index, uint32_t seed)
+{
+	index = owen_scramble(index, seed);
+	const auto x = owen_scramble(sobol(index, 0), hash_combine(seed, 0));
+	const auto y = owen_scramble(sobol(index, 1), hash_combine(seed, 1));
+	return luc::Vector2(sample_to_float(x), sample_to_float(y));
+}
+
+// void and cluster ranked 64 x 64 tile, built on first use, values are rank / 4096
+struct blue_noise_table
+{
+	static constexpr int size = 64;
+	std::vector<float> values;
+
+	static const blue_noise_table& get()
+	{
+		static const blue_noise_table table;
+		return table;
+	}
+
+	float operator()(uint32_t x, uint32_t y) const
+	{
+		return values[(x % size) + (y % size) * size];
+	}
+
+	blue_noise_table()
+	{
+		constexpr int count = size * size;
+		constexpr int radius = 6;
+		constexpr float sigma = 1.5f;
+		std::array<float, (2 * radius + 1) * (2 * radius + 1)> kernel;
+		for (int dy = -radius; dy <= radius; dy++)
+		{
+			for (int dx = -radius; dx <= radius; dx++)
+			{
+				kernel[(dx + radius) + (dy + radius) * (2 * radius + 1)] = std::exp(-float(dx * dx + dy * dy) / (2.f * sigma * sigma));
+			}
+		}
+		auto splat = [&](std::vector<float>& energy, int index, float sign)
+		{
+			const auto x = index % size;
+			const auto y = index / size;
+			for (int dy = -radius; dy <= radius; dy++)
+			{
+				for (int dx = -radius; dx <= radius; dx++)
+				{
+					const auto target = ((x + dx + size) % size) + ((y + dy + size) % size) * size;
+					energy[target] += sign * kernel[(dx + radius) + (dy + radius) * (2 * radius + 1)];
+				}
+			}
+		};
+		auto tightest_cluster = [&](const std::vector<uint8_t>& pattern, const std::vector<float>& energy)
+		{
+			int best = -1;
+			for (int i = 0; i < count; i++)
+			{
+				if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+					best = i;
+			}
+			return best;
+		};
+		auto largest_void = [&](const std::vector<uint8_t>& pattern, const std::vector<float>& energy)
+		{
+			int best = -1;
+			for (int i = 0; i < count; i++)
+			{
+				if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+					best = i;
+			}
+			return best;
+		};
+
+		std::vector<uint8_t> initial(count, 0);
+		std::vector<float> initial_energy(count, 0.f);
+		int ones = 0;
+		for (int i = 0; ones < count / 10; i++)
+		{
+			const auto index = int(hash_combine(0x5eed, uint32_t(i)) % count);
+			if (initial[index])
+				continue;
+			initial[index] = 1;
+			splat(initial_energy, index, 1.f);
+			ones++;
+		}
+		for (int iteration = 0; iteration < count; iteration++)
+		{
+			const auto cluster = tightest_cluster(initial, initial_energy);
+			initial[cluster] = 0;
+			splat(initial_energy, cluster, -1.f);
+			const auto hole = largest_void(initial, initial_energy);
+			initial[hole] = 1;
+			splat(initial_energy, hole, 1.f);
+			if (hole == cluster)
+				break;
+		}
+
+		std::vector<int> ranks(count, 0);
+		auto pattern = initial;
+		auto energy = initial_energy;
+		for (int rank = ones - 1; rank >= 0; rank--)
+		{
+			const auto cluster = tightest_cluster(pattern, energy);
+			pattern[cluster] = 0;
+			splat(energy, cluster, -1.f);
+			ranks[cluster] = rank;
+		}
+		pattern = std::move(initial);
+		energy = std::move(initial_energy);
+		for (int rank = ones; rank < count; rank++)
+		{
+			const auto hole = largest_void(pattern, energy);
+			pattern[hole] = 1;
+			splat(energy, hole, 1.f);
+			ranks[hole] = rank;
+		}
+		values.resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			values[i] = (float(ranks[i]) + .5f) / float(count);
+		}
+	}
+};
+
+enum class sample_pattern
+{
+	// independent owen scrambled sobol per pixel and dimension, best convergence per pixel
+	owen_sobol,
+	// one owen scrambled sobol sequence shared by all pixels and rotated by a blue noise
+	// tile, error at low sample counts is pushed to high frequencies on screen
+	blue_noise,
+};
+
+// dimensions are 2d pairs, dimension 0 is used by iterate_over_tile for the pixel footprint
+struct sampler
+{
+	sample_pattern pattern = sample_pattern::owen_sobol;
+	uint32_t sample_count = 16;
+	uint32_t seed = 0;
+
+	luc::Vector2 get_2d(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const
+	{
+		if (pattern == sample_pattern::owen_sobol)
+			return owen_sobol_2d(sample, hash_combine(hash_combine(hash_combine(seed, x), y), dimension));
+		const auto point = owen_sobol_2d(sample, hash_combine(seed, dimension));
+		const auto& table = blue_noise_table::get();
+		const auto offset = hash_combine(seed ^ 0xb1e, dimension);
+		const auto rotate_x = table(x + (offset & 63), y + ((offset >> 6) & 63));
+		const auto rotate_y = table(x + ((offset >> 12) & 63), y + ((offset >> 18) & 63));
+		const auto u = point.x + rotate_x;
+		const auto v = point.y + rotate_y;
+		return luc::Vector2(u < 1.f ? u : u - 1.f, v < 1.f ? v : v - 1.f);
+	}
+
+	float get_1d(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const
+	{
+		return get_2d(x, y, sample, dimension).x;
+	}
+
+	// writes all sample_count samples of one pixel and dimension
+	void get_2d_batch(uint32_t x, uint32_t y, uint32_t dimension, luc::Vector2* samples) const
+	{
+		for (uint32_t i = 0; i < sample_count; i++)
+		{
+			samples[i] = get_2d(x, y, i, dimension);
+		}
+	}
+};
+
+// the samples of one pixel, film holds dimension 0 of every sample already centered on
+// [-0.5, 0.5) so it can be handed straight to transform
+struct pixel_samples
+{
+	const sampler* source;
+	uint32_t x, y;
+	const luc::Vector2* film;
+
+	uint32_t count() const
+	{
+		return source->sample_count;
+	}
+	luc::Vector2 film_sample(uint32_t sample) const
+	{
+		return film[sample];
+	}
+	luc::Vector2 get_2d(uint32_t sample, uint32_t dimension) const
+	{
+		return source->get_2d(x, y, sample, dimension);
+	}
+	float get_1d(uint32_t sample, uint32_t dimension) const
+	{
+		return source->get_1d(x, y, sample, dimension);
+	}
+	void get_2d_batch(uint32_t dimension, luc::Vector2* samples) const
+	{
+		source->get_2d_batch(x, y, dimension, samples);
+	}
+};
+
+// item_func(x, y, transform, samples) gets every pixel of the tile with its film samples
+// generated in one batch, the batch lives in the worker's scratch arena when there is one, inside
+// fork_join_for pass the chunk's block so it is the arena of the worker running the chunk
+template<typename TSize, typename TFloat = float>
+void iterate_over_tile(const work_block<TSize>& block, const sampler& source, auto&& item_func)
+{
+	std::vector<luc::Vector2> fallback;
+	luc::Vector2* film;
+	if (block.scratch)
+	{
+		film = block.scratch->template allocate_array<luc::Vector2>(source.sample_count);
+		std::uninitialized_default_construct_n(film, source.sample_count);
+	}
+	else
+	{
+		fallback.resize(source.sample_count);
+		film = fallback.data();
+	}
+	iterate_over_tile<TSize, TFloat>(block, [&](TSize x, TSize y, auto&& transform)
+	{
+		source.get_2d_batch(uint32_t(x), uint32_t(y), 0, film);
+		for (uint32_t i = 0; i < source.sample_count; i++)
+		{
+			film[i] = luc::Vector2(film[i].x - .5f, film[i].y - .5f);
+		}
+		item_func(x, y, transform, pixel_samples{ &source, uint32_t(x), uint32_t(y), film });
+	});
+}
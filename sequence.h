@@ -0,0 +1,153 @@
+#pragma once
+#include "parallel_for.h"
+#include "swap_chain.h"
+#include <deque>
+
+// normalized time of a frame for animated<T>::lerp, first frame at 0 and last at 1
+inline float sequence_time(int frame, int frame_count)
+{
+	return frame_count > 1 ? float(frame) / float(frame_count - 1) : 0.f;
+}
+
+// renders frames back to back on one set of workers, the tiles of the next frame are queued as
+// soon as the current queue runs low so stragglers overlap with new work, tile_func(frame, time,
+// block, framebuffer) renders a tile and frame_func(frame, framebuffer) receives finished frames
+// in order on the calling thread, at most frames_in_flight (at least 1) framebuffers are alive at once
+template<typename TColor>
+bool render_sequence(int frame_count, int width, int height, auto&& tile_func, auto&& frame_func, abort_token& aborter, int frames_in_flight = 2)
+{
+	struct frame_state
+	{
+		framebuffer<TColor> pixels;
+		long remaining = 0;
+	};
+	struct sequence_item
+	{
+		int frame;
+		work_range<int> tile;
+	};
+	if (frame_count <= 0)
+		return true;
+	// with no frame in flight nothing could ever be queued
+	frames_in_flight = std::max(frames_in_flight, 1);
+	const auto domain = generate_parallel_for_domain(width, height);
+	const auto thread_count = parallel_for_thread_count();
+	const auto frame_area = long(width) * long(height);
+	framebuffer_pool<TColor> buffers;
+	fork_join pool;
+	std::deque<sequence_item> queue;
+	std::deque<frame_state> frames;
+	int first_frame = 0, next_frame = 0;
+	size_t active_tiles = 0;
+	bool enqueuing = false;
+
+	auto can_enqueue = [&]()
+	{
+		return !enqueuing && next_frame < frame_count && next_frame - first_frame < frames_in_flight;
+	};
+	// the framebuffer is acquired outside the lock, enqueuing keeps other workers from queueing
+	// the same frame meanwhile
+	auto enqueue_frame = [&](std::unique_lock<std::mutex>& lock)
+	{
+		enqueuing = true;
+		lock.unlock();
+		auto pixels = buffers.acquire(width, height);
+		lock.lock();
+		frames.push_back({ std::move(pixels), frame_area });
+		for (const auto& range : domain.ranges)
+		{
+			queue.push_back({ next_frame, range });
+		}
+		next_frame++;
+		enqueuing = false;
+		pool.signal.notify_all();
+	};
+	auto arenas = arena_pool::global().acquire(thread_count);
+	for (const auto& scratch : arenas)
+		pool.scratch.push_back(scratch.get());
+	// the same worker loop as parallel_for with the tile queue refilled frame by frame, tiles can
+	// fork subtasks into pool and idle workers pick them up
+	auto worker = [&](size_t index)
+	{
+		work_block<int> block(domain.range, domain.range);
+		block.micro_size = domain.micro_size;
+		block.pool = &pool;
+		block.worker = index;
+		block.scratch = arenas[index].get();
+		std::unique_lock lock(pool.mutex);
+		while (!aborter.aborted)
+		{
+			if (queue.size() < thread_count && can_enqueue())
+			{
+				enqueue_frame(lock);
+				continue;
+			}
+			if (queue.empty())
+			{
+				if (pool.run_one(lock, index))
+					continue;
+				if (next_frame == frame_count && !enqueuing && active_tiles == 0)
+					break;
+				pool.signal.wait(lock, [&]()
+				{
+					return aborter.aborted || !queue.empty() || !pool.tasks.empty() || can_enqueue() || (next_frame == frame_count && !enqueuing && active_tiles == 0);
+				});
+				continue;
+			}
+			auto item = queue.front();
+			queue.pop_front();
+			const auto w = item.tile.maxx - item.tile.minx;
+			const auto h = item.tile.maxy - item.tile.miny;
+			if (!can_enqueue() && queue.size() < thread_count && std::min(w, h) > domain.split_size)
+			{
+				const auto split = split_range(item.tile);
+				queue.push_front({ item.frame, split.second });
+				item.tile = split.first;
+			}
+			const auto area = long(item.tile.maxx - item.tile.minx) * long(item.tile.maxy - item.tile.miny);
+			auto& frame = frames[item.frame - first_frame].pixels;
+			active_tiles++;
+			lock.unlock();
+			block.tile = item.tile;
+			tile_func(item.frame, sequence_time(item.frame, frame_count), block, frame);
+			block.scratch->reset();
+			lock.lock();
+			active_tiles--;
+			frames[item.frame - first_frame].remaining -= area;
+			pool.signal.notify_all();
+		}
+		pool.signal.notify_all();
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back(worker, i);
+	}
+	{
+		std::unique_lock lock(pool.mutex);
+		while (first_frame < frame_count && !aborter.aborted)
+		{
+			pool.signal.wait(lock, [&]()
+			{
+				return aborter.aborted || (!frames.empty() && frames.front().remaining == 0);
+			});
+			if (aborter.aborted)
+				break;
+			auto finished = std::move(frames.front().pixels);
+			lock.unlock();
+			frame_func(first_frame, finished);
+			buffers.release(std::move(finished));
+			lock.lock();
+			frames.pop_front();
+			first_frame++;
+			pool.signal.notify_all();
+		}
+	}
+	pool.signal.notify_all();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	arena_pool::global().release(std::move(arenas));
+	return first_frame == frame_count;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "framebuffer.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// recycles framebuffers of the same size, a recycled buffer keeps the previous frame's pixels
+// instead of being cleared, so it only suits renders that write every pixel
+template<typename TColor>
+struct framebuffer_pool
+{
+	std::mutex mutex;
+	std::vector<framebuffer<TColor>> free;
+
+	framebuffer<TColor> acquire(int width, int height)
+	{
+		{
+			std::scoped_lock lock(mutex);
+			for (auto it = free.begin(); it != free.end(); ++it)
+			{
+				if (it->pixels.size() == size_t(width) * size_t(height))
+				{
+					auto result = std::move(*it);
+					free.erase(it);
+					result.width = width;
+					result.height = height;
+					return result;
+				}
+			}
+		}
+		return framebuffer<TColor>(width, height);
+	}
+
+	void release(framebuffer<TColor>&& buffer)
+	{
+		std::scoped_lock lock(mutex);
+		free.push_back(std::move(buffer));
+	}
+};
+
+// a fixed ring of buffers moving between a render thread and a present thread, frames are
+// delivered in order unless mailbox is set, then only the newest finished frame is presented
+template<typename TColor>
+struct swap_chain
+{
+	std::mutex mutex;
+	std::condition_variable signal;
+	std::vector<framebuffer<TColor>> buffers;
+	std::deque<size_t> free, ready;
+	bool mailbox;
+	bool closed = false;
+
+	swap_chain(int width, int height, size_t count = 3, bool _mailbox = false) : mailbox(_mailbox)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			buffers.emplace_back(width, height);
+			free.push_back(i);
+		}
+	}
+
+	framebuffer<TColor>& operator[](size_t index)
+	{
+		return buffers[index];
+	}
+
+	std::optional<size_t> acquire_render()
+	{
+		std::unique_lock lock(mutex);
+		signal.wait(lock, [&]() { return closed || !free.empty(); });
+		if (closed)
+			return std::nullopt;
+		const auto index = free.front();
+		free.pop_front();
+		return index;
+	}
+
+	void submit(size_t index)
+	{
+		{
+			std::scoped_lock lock(mutex);
+			if (mailbox)
+			{
+				free.insert(free.end(), ready.begin(), ready.end());
+				ready.clear();
+			}
+			ready.push_back(index);
+		}
+		signal.notify_all();
+	}
+
+	std::optional<size_t> acquire_present()
+	{
+		std::unique_lock lock(mutex);
+		signal.wait(lock, [&]() { return closed || !ready.empty(); });
+		if (ready.empty())
+			return std::nullopt;
+		const auto index = ready.front();
+		ready.pop_front();
+		return index;
+	}
+
+	void release_present(size_t index)
+	{
+		{
+			std::scoped_lock lock(mutex);
+			free.push_back(index);
+		}
+		signal.notify_all();
+	}
+
+	void close()
+	{
+		{
+			std::scoped_lock lock(mutex);
+			closed = true;
+		}
+		signal.notify_all();
+	}
+};
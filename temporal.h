@@ -0,0 +1,118 @@
+#pragma once
+#include "render.h"
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+
+// keeps the previous frame with its depth, reproject_func(x, y, depth) maps a previous raster
+// position to the new one as (x, y, depth) or std::nullopt when it leaves the view
+template<typename TColor>
+struct temporal_cache
+{
+	int width, height;
+	framebuffer<TColor> color, history;
+	framebuffer<float> depth, history_depth;
+	framebuffer<uint8_t> age, history_age;
+	framebuffer<uint8_t> dirty;
+	std::unique_ptr<std::atomic<uint64_t>[]> nearest;
+	bool valid = false;
+
+	temporal_cache(int _width, int _height) : width(_width), height(_height), color(_width, _height), history(_width, _height), depth(_width, _height), history_depth(_width, _height), age(_width, _height), history_age(_width, _height), dirty(_width, _height)
+	{
+		nearest = std::make_unique<std::atomic<uint64_t>[]>(size_t(width) * size_t(height));
+	}
+
+	void invalidate()
+	{
+		valid = false;
+	}
+
+	// splats the previous frame into the new view keeping the closest surface per pixel, pixels
+	// nothing lands on or that are older than max_age frames are marked in the returned mask
+	const framebuffer<uint8_t>& reproject(auto&& reproject_func, int max_age, abort_token& aborter)
+	{
+		std::swap(color, history);
+		std::swap(depth, history_depth);
+		std::swap(age, history_age);
+		if (!valid)
+		{
+			std::fill(dirty.pixels.begin(), dirty.pixels.end(), uint8_t(1));
+			return dirty;
+		}
+		const uint64_t empty = std::numeric_limits<uint64_t>::max();
+		const auto domain = generate_parallel_for_domain(width, height);
+		parallel_for(domain, [&](const work_block<int>& block)
+		{
+			for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+			{
+				for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+				{
+					nearest[x + y * width].store(empty, std::memory_order_relaxed);
+				}
+			}
+		}, aborter);
+		parallel_for(domain, [&](const work_block<int>& block)
+		{
+			for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+			{
+				for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+				{
+					const auto source = x + y * width;
+					const std::optional<luc::Vector3> target = reproject_func(x + .5f, y + .5f, history_depth.pixels[source]);
+					if (!target || !(target->z >= 0.f))
+						continue;
+					const auto tx = int(std::floor(target->x)), ty = int(std::floor(target->y));
+					if (tx < 0 || ty < 0 || tx >= width || ty >= height)
+						continue;
+					const auto key = (uint64_t(std::bit_cast<uint32_t>(target->z)) << 32) | uint64_t(source);
+					auto& slot = nearest[tx + ty * width];
+					auto current = slot.load(std::memory_order_relaxed);
+					while (key < current && !slot.compare_exchange_weak(current, key, std::memory_order_relaxed)) {}
+				}
+			}
+		}, aborter);
+		parallel_for(domain, [&](const work_block<int>& block)
+		{
+			for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+			{
+				for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+				{
+					const auto index = x + y * width;
+					const auto key = nearest[index].load(std::memory_order_relaxed);
+					if (key == empty || history_age.pixels[uint32_t(key)] >= max_age)
+					{
+						dirty.pixels[index] = 1;
+						continue;
+					}
+					const auto source = uint32_t(key);
+					color.pixels[index] = history.pixels[source];
+					depth.pixels[index] = std::bit_cast<float>(uint32_t(key >> 32));
+					age.pixels[index] = uint8_t(history_age.pixels[source] + 1);
+					dirty.pixels[index] = 0;
+				}
+			}
+		}, aborter);
+		return dirty;
+	}
+};
+
+// tile_func fills cache.color and cache.depth for the tiles it is given, everything else is reused
+template<typename TColor>
+void render_temporal(temporal_cache<TColor>& cache, auto&& reproject_func, auto&& tile_func, abort_token& aborter, int max_age = 16)
+{
+	const auto& dirty = cache.reproject(reproject_func, std::min(max_age, 255), aborter);
+	const auto domain = generate_parallel_for_domain(dirty);
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		tile_func(block);
+		for (auto y = block.tile.miny; y < block.tile.maxy; y++)
+		{
+			for (auto x = block.tile.minx; x < block.tile.maxx; x++)
+			{
+				cache.age.pixel(x, y) = 0;
+			}
+		}
+	}, aborter);
+	cache.valid = !aborter.aborted;
+}
@@ -0,0 +1,366 @@
+#pragma once
+#include "framebuffer.h"
+#include "pixel_formats.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct texture_file_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t page_size;
+	uint32_t levels;
+	uint64_t page_stride;
+	uint64_t data_offset;
+};
+
+struct texture_level
+{
+	uint32_t width, height;
+	uint32_t pages_x, pages_y;
+	uint64_t first_page;
+};
+
+inline std::vector<texture_level> texture_level_layout(int width, int height, int page_size)
+{
+	std::vector<texture_level> levels;
+	uint64_t first_page = 0;
+	for (;;)
+	{
+		const auto pages_x = uint32_t((width + page_size - 1) / page_size);
+		const auto pages_y = uint32_t((height + page_size - 1) / page_size);
+		levels.push_back({ uint32_t(width), uint32_t(height), pages_x, pages_y, first_page });
+		first_page += uint64_t(pages_x) * pages_y;
+		if (width == 1 && height == 1)
+			return levels;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+}
+
+// writes the full mip chain as page_size x page_size pages of half4, edge pages are padded by
+// repeating the last row and column, every page starts on a page boundary of the file
+inline bool write_texture(const char* path, const framebuffer<luc::Vector4>& image, int page_size = 64)
+{
+	const auto levels = texture_level_layout(image.width, image.height, page_size);
+	const auto os_page = size_t(sysconf(_SC_PAGESIZE));
+	const auto round_up = [os_page](size_t bytes) { return (bytes + os_page - 1) / os_page * os_page; };
+	const auto page_stride = round_up(size_t(page_size) * size_t(page_size) * sizeof(half4));
+	const auto data_offset = round_up(sizeof(texture_file_header) + levels.size() * sizeof(texture_level));
+	auto* file = std::fopen(path, "wb");
+	if (!file)
+		return false;
+	texture_file_header header{ { 'L', 'T', 'E', 'X' }, 1, uint32_t(image.width), uint32_t(image.height), uint32_t(page_size), uint32_t(levels.size()), page_stride, data_offset };
+	std::vector<uint8_t> block(data_offset, 0);
+	std::memcpy(block.data(), &header, sizeof(header));
+	std::memcpy(block.data() + sizeof(header), levels.data(), levels.size() * sizeof(texture_level));
+	auto ok = std::fwrite(block.data(), 1, block.size(), file) == block.size();
+
+	auto level_image = image;
+	std::vector<luc::Vector4> texels(size_t(page_size) * size_t(page_size));
+	block.assign(page_stride, 0);
+	for (size_t level = 0; level < levels.size() && ok; level++)
+	{
+		if (level > 0)
+		{
+			framebuffer<luc::Vector4> smaller(int(levels[level].width), int(levels[level].height));
+			for (int y = 0; y < smaller.height; y++)
+			{
+				for (int x = 0; x < smaller.width; x++)
+				{
+					const auto x0 = std::min(2 * x, level_image.width - 1), x1 = std::min(2 * x + 1, level_image.width - 1);
+					const auto y0 = std::min(2 * y, level_image.height - 1), y1 = std::min(2 * y + 1, level_image.height - 1);
+					const auto sum = level_image.pixel(x0, y0) + level_image.pixel(x1, y0) + level_image.pixel(x0, y1) + level_image.pixel(x1, y1);
+					smaller.pixel(x, y) = sum * .25f;
+				}
+			}
+			level_image = std::move(smaller);
+		}
+		for (uint32_t py = 0; py < levels[level].pages_y && ok; py++)
+		{
+			for (uint32_t px = 0; px < levels[level].pages_x && ok; px++)
+			{
+				for (int y = 0; y < page_size; y++)
+				{
+					for (int x = 0; x < page_size; x++)
+					{
+						const auto sx = std::min(int(px) * page_size + x, level_image.width - 1);
+						const auto sy = std::min(int(py) * page_size + y, level_image.height - 1);
+						texels[x + y * page_size] = level_image.pixel(sx, sy);
+					}
+				}
+				convert_pixels(texels.data(), reinterpret_cast<half4*>(block.data()), texels.size());
+				ok = std::fwrite(block.data(), 1, block.size(), file) == block.size();
+			}
+		}
+	}
+	return std::fclose(file) == 0 && ok;
+}
+
+// read only mapping of a texture written by write_texture, nothing is read until a page is
+// loaded and the pages are dropped from the mapping again once copied out
+struct texture_file
+{
+	texture_file_header header{};
+	std::vector<texture_level> levels;
+	int file = -1;
+	size_t file_size = 0;
+	const uint8_t* mapping = nullptr;
+
+	texture_file() = default;
+	texture_file(const texture_file&) = delete;
+	texture_file& operator=(const texture_file&) = delete;
+	~texture_file() { close(); }
+
+	bool open(const char* path)
+	{
+		close();
+		struct stat status;
+		file = ::open(path, O_RDONLY);
+		if (file < 0 || fstat(file, &status) != 0 || pread(file, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || std::memcmp(header.magic, "LTEX", 4) != 0)
+		{
+			close();
+			return false;
+		}
+		file_size = size_t(status.st_size);
+		if (header.levels == 0 || header.levels > 64 || header.page_size == 0)
+		{
+			close();
+			return false;
+		}
+		levels.resize(header.levels);
+		const auto table_size = ssize_t(levels.size() * sizeof(texture_level));
+		if (pread(file, levels.data(), size_t(table_size), sizeof(header)) != table_size || header.data_offset + (levels.back().first_page + 1) * header.page_stride > file_size)
+		{
+			close();
+			return false;
+		}
+		auto* address = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (address == MAP_FAILED)
+		{
+			close();
+			return false;
+		}
+		mapping = static_cast<const uint8_t*>(address);
+		return true;
+	}
+
+	void close()
+	{
+		if (mapping)
+		{
+			munmap(const_cast<uint8_t*>(mapping), file_size);
+			mapping = nullptr;
+		}
+		if (file >= 0)
+		{
+			::close(file);
+			file = -1;
+		}
+	}
+
+	int page_size() const { return int(header.page_size); }
+
+	void load_page(uint64_t page, luc::Vector4* texels) const
+	{
+		const auto* data = mapping + header.data_offset + page * header.page_stride;
+		convert_pixels(reinterpret_cast<const half4*>(data), texels, size_t(header.page_size) * header.page_size);
+		madvise(const_cast<uint8_t*>(data), header.page_stride, MADV_DONTNEED);
+	}
+};
+
+struct texture_page
+{
+	std::vector<luc::Vector4> texels;
+};
+
+// pages of every added texture share one memory budget, split over shards that each keep their
+// own lru list behind their own mutex, lookups first go through a small per thread cache that
+// needs no locking at all, pages held there may outlive their eviction until replaced so the
+// budget can be exceeded by at most micro_cache_size pages per thread
+struct texture_cache
+{
+	static constexpr size_t micro_cache_size = 16;
+
+	struct shard
+	{
+		std::mutex mutex;
+		std::list<std::pair<uint64_t, std::shared_ptr<const texture_page>>> lru;
+		std::unordered_map<uint64_t, decltype(lru)::iterator> index;
+		size_t bytes = 0;
+	};
+
+	struct micro_cache
+	{
+		struct slot
+		{
+			uint64_t owner = 0;
+			uint64_t key = 0;
+			std::shared_ptr<const texture_page> page;
+		};
+		std::array<slot, micro_cache_size> slots;
+	};
+
+	std::vector<std::unique_ptr<texture_file>> textures;
+	std::vector<std::unique_ptr<shard>> shards;
+	size_t shard_budget;
+	uint64_t id;
+	// only counted on micro cache misses, a shared counter on the hit path would bounce between cores
+	std::atomic<size_t> shared_hits = 0, loads = 0;
+
+	texture_cache(size_t budget_bytes, size_t shard_count = 16) : shard_budget(budget_bytes / std::max<size_t>(shard_count, 1))
+	{
+		static std::atomic<uint64_t> next_id = 1;
+		id = next_id++;
+		for (size_t i = 0; i < std::max<size_t>(shard_count, 1); i++)
+		{
+			shards.push_back(std::make_unique<shard>());
+		}
+	}
+
+	// not safe to call while other threads look up textures, returns -1 when the file can not be opened
+	int add(const char* path)
+	{
+		auto file = std::make_unique<texture_file>();
+		if (!file->open(path))
+			return -1;
+		textures.push_back(std::move(file));
+		return int(textures.size() - 1);
+	}
+
+	const texture_level& level(int texture, int level) const
+	{
+		return textures[texture]->levels[level];
+	}
+
+	int level_count(int texture) const
+	{
+		return int(textures[texture]->levels.size());
+	}
+
+	// texel with repeat addressing
+	luc::Vector4 texel(int texture, int level_index, int x, int y)
+	{
+		const auto& info = level(texture, level_index);
+		const auto width = int(info.width), height = int(info.height);
+		x = ((x % width) + width) % width;
+		y = ((y % height) + height) % height;
+		const auto page_size = textures[texture]->page_size();
+		const auto px = uint32_t(x / page_size), py = uint32_t(y / page_size);
+		const auto& texels = page(texture, info.first_page + px + py * uint64_t(info.pages_x)).texels;
+		return texels[x % page_size + (y % page_size) * page_size];
+	}
+
+	luc::Vector4 bilinear(int texture, int level_index, float u, float v)
+	{
+		const auto& info = level(texture, level_index);
+		const auto s = u * float(info.width) - .5f;
+		const auto t = v * float(info.height) - .5f;
+		const auto x = std::floor(s), y = std::floor(t);
+		const auto fx = s - x, fy = t - y;
+		const auto ix = int(x), iy = int(y);
+		const auto top = luc::Lerp(fx, texel(texture, level_index, ix, iy), texel(texture, level_index, ix + 1, iy));
+		const auto bottom = luc::Lerp(fx, texel(texture, level_index, ix, iy + 1), texel(texture, level_index, ix + 1, iy + 1));
+		return luc::Lerp(fy, top, bottom);
+	}
+
+	// footprint is the width of the filter region in uv units, it picks the two nearest levels
+	luc::Vector4 trilinear(int texture, float u, float v, float footprint)
+	{
+		const auto& base = level(texture, 0);
+		const auto texels = footprint * float(std::max(base.width, base.height));
+		const auto lod = std::clamp(std::log2(std::max(texels, 1e-8f)), 0.f, float(level_count(texture) - 1));
+		const auto lower = int(lod);
+		const auto fraction = lod - float(lower);
+		const auto sample = bilinear(texture, lower, u, v);
+		if (fraction == 0.f || lower + 1 >= level_count(texture))
+			return sample;
+		return luc::Lerp(fraction, sample, bilinear(texture, lower + 1, u, v));
+	}
+
+	size_t resident_bytes()
+	{
+		size_t bytes = 0;
+		for (auto& target : shards)
+		{
+			std::scoped_lock lock(target->mutex);
+			bytes += target->bytes;
+		}
+		return bytes;
+	}
+
+private:
+	// the reference points into this thread's micro cache slot and only lives until the next
+	// page() call on this thread, so it stays internal to the sampling path
+	const texture_page& page(int texture, uint64_t page_index)
+	{
+		const auto key = (uint64_t(texture) << 40) | page_index;
+		thread_local micro_cache micro;
+		auto& slot = micro.slots[(key ^ (key >> 40)) % micro_cache_size];
+		if (slot.owner == id && slot.key == key && slot.page)
+			return *slot.page;
+		slot.page = shared_page(texture, key, page_index);
+		slot.owner = id;
+		slot.key = key;
+		return *slot.page;
+	}
+
+	std::shared_ptr<const texture_page> shared_page(int texture, uint64_t key, uint64_t page_index)
+	{
+		auto& target = *shards[hash_key(key) % shards.size()];
+		{
+			std::scoped_lock lock(target.mutex);
+			const auto found = target.index.find(key);
+			if (found != target.index.end())
+			{
+				target.lru.splice(target.lru.begin(), target.lru, found->second);
+				shared_hits.fetch_add(1, std::memory_order_relaxed);
+				return found->second->second;
+			}
+		}
+		// loaded outside the lock, a page loaded twice by racing threads is simply dropped again
+		const auto& file = *textures[texture];
+		auto loaded = std::make_shared<texture_page>();
+		loaded->texels.resize(size_t(file.page_size()) * size_t(file.page_size()));
+		file.load_page(page_index, loaded->texels.data());
+		loads.fetch_add(1, std::memory_order_relaxed);
+		const auto page_bytes = loaded->texels.size() * sizeof(luc::Vector4);
+		std::scoped_lock lock(target.mutex);
+		const auto found = target.index.find(key);
+		if (found != target.index.end())
+			return found->second->second;
+		target.lru.emplace_front(key, std::move(loaded));
+		target.index[key] = target.lru.begin();
+		target.bytes += page_bytes;
+		while (target.bytes > shard_budget && target.lru.size() > 1)
+		{
+			target.bytes -= target.lru.back().second->texels.size() * sizeof(luc::Vector4);
+			target.index.erase(target.lru.back().first);
+			target.lru.pop_back();
+		}
+		return target.lru.front().second;
+	}
+
+	static uint64_t hash_key(uint64_t key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		return key;
+	}
+};
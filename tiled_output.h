@@ -0,0 +1,171 @@
+#pragma once
+#include "parallel_for.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct tiled_file_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t tile_size;
+	uint32_t bytes_per_pixel;
+	uint64_t tile_stride;
+	uint64_t data_offset;
+};
+
+// tiles are stored padded to tile_size x tile_size and page aligned, so a finished tile can be
+// flushed and dropped from the address space without touching its neighbours
+template<typename TColor>
+struct tiled_framebuffer
+{
+	int width = 0, height = 0, tile_size = 0;
+	int tiles_x = 0, tiles_y = 0;
+	size_t tile_stride = 0, data_offset = 0, file_size = 0;
+	int file = -1;
+	uint8_t* mapping = nullptr;
+	std::unique_ptr<std::atomic<int>[]> remaining;
+
+	tiled_framebuffer() = default;
+	tiled_framebuffer(const tiled_framebuffer&) = delete;
+	tiled_framebuffer& operator=(const tiled_framebuffer&) = delete;
+	~tiled_framebuffer() { close(); }
+
+	bool create(const char* path, int _width, int _height, int _tile_size = 64)
+	{
+		close();
+		width = _width;
+		height = _height;
+		tile_size = _tile_size;
+		layout();
+		file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (file < 0 || ftruncate(file, off_t(file_size)) != 0 || !map())
+		{
+			close();
+			return false;
+		}
+		tiled_file_header header{ { 'L', 'T', 'I', 'L' }, 1, uint32_t(width), uint32_t(height), uint32_t(tile_size), uint32_t(sizeof(TColor)), tile_stride, data_offset };
+		std::memcpy(mapping, &header, sizeof(header));
+		return true;
+	}
+
+	bool open(const char* path)
+	{
+		close();
+		tiled_file_header header;
+		file = ::open(path, O_RDWR);
+		if (file < 0 || pread(file, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || std::memcmp(header.magic, "LTIL", 4) != 0 || header.bytes_per_pixel != sizeof(TColor))
+		{
+			close();
+			return false;
+		}
+		width = int(header.width);
+		height = int(header.height);
+		tile_size = int(header.tile_size);
+		layout();
+		if (tile_stride != header.tile_stride || data_offset != header.data_offset || !map())
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (mapping)
+		{
+			msync(mapping, file_size, MS_SYNC);
+			munmap(mapping, file_size);
+			mapping = nullptr;
+		}
+		if (file >= 0)
+		{
+			::close(file);
+			file = -1;
+		}
+	}
+
+	bool is_open() const { return mapping != nullptr; }
+
+	int tile_index(int x, int y) const
+	{
+		return x / tile_size + (y / tile_size) * tiles_x;
+	}
+
+	TColor* tile_pixels(int index)
+	{
+		return reinterpret_cast<TColor*>(mapping + data_offset + size_t(index) * tile_stride);
+	}
+
+	TColor& pixel(int x, int y)
+	{
+		auto* tile = tile_pixels(tile_index(x, y));
+		return tile[x % tile_size + (y % tile_size) * tile_size];
+	}
+
+	// schedules write-back of a finished tile and unmaps its pages, the dirty data stays in the
+	// page cache where the kernel can write it out and reclaim it
+	void release_tile(int index)
+	{
+		auto* tile = reinterpret_cast<uint8_t*>(tile_pixels(index));
+		msync(tile, tile_stride, MS_ASYNC);
+		madvise(tile, tile_stride, MADV_DONTNEED);
+	}
+
+	void complete(const work_range<int>& range)
+	{
+		const auto index = tile_index(range.minx, range.miny);
+		const auto area = (range.maxx - range.minx) * (range.maxy - range.miny);
+		if (remaining[index].fetch_sub(area) == area)
+			release_tile(index);
+	}
+
+private:
+	void layout()
+	{
+		const auto page_size = size_t(sysconf(_SC_PAGESIZE));
+		const auto round_up = [page_size](size_t bytes) { return (bytes + page_size - 1) / page_size * page_size; };
+		tiles_x = (width + tile_size - 1) / tile_size;
+		tiles_y = (height + tile_size - 1) / tile_size;
+		tile_stride = round_up(size_t(tile_size) * size_t(tile_size) * sizeof(TColor));
+		data_offset = round_up(sizeof(tiled_file_header));
+		file_size = data_offset + size_t(tiles_x) * size_t(tiles_y) * tile_stride;
+		remaining = std::make_unique<std::atomic<int>[]>(size_t(tiles_x) * size_t(tiles_y));
+		for (int ty = 0; ty < tiles_y; ty++)
+		{
+			for (int tx = 0; tx < tiles_x; tx++)
+			{
+				const auto w = std::min(tile_size, width - tx * tile_size);
+				const auto h = std::min(tile_size, height - ty * tile_size);
+				remaining[tx + ty * tiles_x] = w * h;
+			}
+		}
+	}
+
+	bool map()
+	{
+		auto* address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (address == MAP_FAILED)
+			return false;
+		mapping = static_cast<uint8_t*>(address);
+		return true;
+	}
+};
+
+template<typename TColor>
+void render_tiled(tiled_framebuffer<TColor>& framebuffer, auto&& tile_func, abort_token& aborter)
+{
+	const auto domain = generate_tiled_domain(framebuffer.width, framebuffer.height, framebuffer.tile_size);
+	parallel_for(domain, [&](const work_block<int>& block)
+	{
+		tile_func(block);
+		framebuffer.complete(block.tile);
+	}, aborter);
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "parallel_for.h"
+#include "framebuffer.h"
+#include "reduce.h"
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+template<typename TFloat = float>
+struct ray_queue
+{
+	std::vector<TFloat> ox, oy, oz;
+	std::vector<TFloat> dx, dy, dz;
+	std::vector<TFloat> tmax;
+	std::vector<TFloat> tr, tg, tb;
+	std::vector<int> pixel;
+	std::vector<int> hit;
+	std::vector<uint8_t> alive;
+	size_t size = 0;
+	static constexpr size_t bytes_per_ray = 10 * sizeof(TFloat) + 2 * sizeof(int) + sizeof(uint8_t);
+	ray_queue() = default;
+	ray_queue(size_t capacity) { resize(capacity); }
+	void resize(size_t capacity)
+	{
+		for (auto* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tmax, &tr, &tg, &tb })
+			v->resize(capacity);
+		pixel.resize(capacity);
+		hit.resize(capacity);
+		alive.resize(capacity);
+	}
+	size_t capacity() const { return pixel.size(); }
+	void reset(size_t i, int pixel_index)
+	{
+		ox[i] = oy[i] = oz[i] = 0;
+		dx[i] = dy[i] = dz[i] = 0;
+		tmax[i] = std::numeric_limits<TFloat>::infinity();
+		tr[i] = tg[i] = tb[i] = 1;
+		pixel[i] = pixel_index;
+		hit[i] = -1;
+		alive[i] = 1;
+	}
+	void copy(size_t dst, const ray_queue& src, size_t i)
+	{
+		ox[dst] = src.ox[i]; oy[dst] = src.oy[i]; oz[dst] = src.oz[i];
+		dx[dst] = src.dx[i]; dy[dst] = src.dy[i]; dz[dst] = src.dz[i];
+		tmax[dst] = src.tmax[i];
+		tr[dst] = src.tr[i]; tg[dst] = src.tg[i]; tb[dst] = src.tb[i];
+		pixel[dst] = src.pixel[i];
+		hit[dst] = src.hit[i];
+		alive[dst] = src.alive[i];
+	}
+};
+
+// three queues (rays, shadow rays, compaction scratch) share the l2 budget
+template<typename TFloat = float>
+size_t wavefront_queue_capacity()
+{
+	const auto max_size = size_t(parallel_for_defaults().max_size);
+	const auto min_capacity = max_size * max_size;
+	return std::max(l2_cache_size() / (3 * ray_queue<TFloat>::bytes_per_ray), min_capacity);
+}
+
+template<typename TSize = int>
+void parallel_for_each_chunk(size_t count, auto&& chunk_func, abort_token& aborter)
+{
+	const TSize chunk_size = 256;
+	const auto domain = generate_parallel_for_domain_1d<TSize>(TSize(count), chunk_size);
+	parallel_for(domain, [&](const work_block<TSize>& block)
+	{
+		chunk_func(size_t(block.tile.minx), size_t(block.tile.maxx));
+	}, aborter);
+}
+
+template<typename TFloat>
+void compact(ray_queue<TFloat>& queue, ray_queue<TFloat>& scratch, abort_token& aborter)
+{
+	const auto domain = generate_parallel_for_domain_1d<int>(int(queue.size), 256);
+	scratch.size = parallel_scan(domain, size_t(0), [&](const work_block<int>& block, size_t& alive)
+	{
+		for (auto i = block.tile.minx; i < block.tile.maxx; i++)
+			alive += queue.alive[i] ? 1 : 0;
+	}, [&](const work_block<int>& block, size_t offset)
+	{
+		for (auto i = block.tile.minx; i < block.tile.maxx; i++)
+			if (queue.alive[i])
+				scratch.copy(offset++, queue, i);
+	}, std::plus<size_t>(), aborter);
+	std::swap(queue, scratch);
+}
+
+// shade(rays, shadows, begin, end, depth) writes the next bounce of ray i back into slot i and sets
+// rays.alive[i] to keep it, and may emit a shadow ray into shadows slot i by setting shadows.alive[i]
+template<typename TColor, typename TFloat = float>
+void render_wavefront(const framebuffer<TColor>& framebuffer, auto&& generate, auto&& intersect, auto&& shade, auto&& shadow, int max_depth, abort_token& aborter, size_t capacity = wavefront_queue_capacity<TFloat>())
+{
+	using TSize = int;
+	const auto domain = generate_parallel_for_domain(framebuffer.width, framebuffer.height);
+	const auto max_size = size_t(parallel_for_defaults().max_size);
+	capacity = std::max(capacity, max_size * max_size);
+	ray_queue<TFloat> rays(capacity), shadows(capacity), scratch(capacity);
+	size_t next_range = 0;
+	while (next_range < domain.ranges.size() && !aborter.aborted)
+	{
+		work_domain<TSize> batch(domain.range.minx, domain.range.maxx, domain.range.miny, domain.range.maxy);
+		size_t batch_size = 0;
+		while (next_range < domain.ranges.size())
+		{
+			const auto& range = domain.ranges[next_range];
+			const auto area = size_t(range.maxx - range.minx) * size_t(range.maxy - range.miny);
+			if (batch_size + area > capacity)
+				break;
+			batch.ranges.push_back(range);
+			batch_size += area;
+			next_range++;
+		}
+		std::atomic<size_t> cursor = 0;
+		parallel_for(batch, [&](const work_block<TSize>& block)
+		{
+			const auto area = size_t(block.tile.maxx - block.tile.minx) * size_t(block.tile.maxy - block.tile.miny);
+			auto i = cursor.fetch_add(area);
+			iterate_over_tile<TSize, TFloat>(block, [&](TSize x, TSize y, auto&& transform)
+			{
+				rays.reset(i, x + y * framebuffer.width);
+				generate(x, y, transform, rays, i);
+				i++;
+			});
+		}, aborter);
+		rays.size = batch_size;
+		for (int depth = 0; depth < max_depth && rays.size > 0 && !aborter.aborted; depth++)
+		{
+			parallel_for_each_chunk(rays.size, [&](size_t begin, size_t end)
+			{
+				intersect(rays, begin, end);
+			}, aborter);
+			std::fill_n(shadows.alive.begin(), rays.size, uint8_t(0));
+			shadows.size = rays.size;
+			parallel_for_each_chunk(rays.size, [&](size_t begin, size_t end)
+			{
+				for (auto i = begin; i < end; i++)
+					rays.alive[i] = 0;
+				shade(rays, shadows, begin, end, depth);
+			}, aborter);
+			compact(shadows, scratch, aborter);
+			parallel_for_each_chunk(shadows.size, [&](size_t begin, size_t end)
+			{
+				shadow(shadows, begin, end);
+			}, aborter);
+			compact(rays, scratch, aborter);
+		}
+	}
+}